@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <string.h> // for memset
+
+#include "analyzer.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    void resetStats(analyzer::CacheStats& stats, unsigned int size)
+    {
+        memset(&stats, 0, sizeof(stats));
+        stats.size = size;
+    }
+
+    void finishStats(analyzer::CacheStats& stats, unsigned int tri_count, unsigned int verts_used)
+    {
+        stats.acmr = tri_count ? (float)stats.misses / tri_count : 0.0f;
+        stats.atvr = verts_used ? (float)stats.misses / verts_used : 0.0f;
+    }
+}
+
+analyzer::analyzer()
+    : VertsUsed(0)
+{
+    unsigned int sizes[] = { 16, 32 };
+    setCacheSizes(sizes, 2);
+}
+
+void analyzer::setCacheSizes(const unsigned int* sizes, unsigned int count)
+{
+    Sizes.clear();
+    for (unsigned int i=0; i<count; ++i)
+        Sizes.push_back(max(1u, min(sizes[i], (unsigned int)MaxCacheSize)));
+
+    Fifo.resize(Sizes.size());
+    Lru.resize(Sizes.size());
+    Batch.resize(Sizes.size());
+    for (size_t i=0; i<Sizes.size(); ++i) {
+        resetStats(Fifo[i], Sizes[i]);
+        resetStats(Lru[i], Sizes[i]);
+        resetStats(Batch[i], Sizes[i]);
+    }
+}
+
+void analyzer::analyze(const unsigned int* indices, unsigned int idx_cnt, unsigned int vert_cnt)
+{
+    const unsigned int size_cnt = (unsigned int)Sizes.size();
+
+    // every pass starts from empty caches
+    FifoStamps.assign((size_t)vert_cnt * size_cnt, 0);
+    FifoInserts.assign(size_cnt, 0);
+    BatchStamps.assign((size_t)vert_cnt * size_cnt, 0);
+    BatchInserts.assign(size_cnt, 0);
+    BatchStarts.assign(size_cnt, 0);
+    InStack.assign(vert_cnt, 0);
+    Stack.clear();
+    VertsUsed = 0;
+
+    for (unsigned int s=0; s<size_cnt; ++s) {
+        resetStats(Fifo[s], Sizes[s]);
+        resetStats(Lru[s], Sizes[s]);
+        resetStats(Batch[s], Sizes[s]);
+    }
+
+    unsigned long long lru_hits[MaxCacheSize] = {};
+
+    for (unsigned int i=0; i<idx_cnt; ++i) {
+        unsigned int vert = indices[i];
+
+        unsigned int* stamps = &FifoStamps[(size_t)vert * size_cnt];
+        for (unsigned int s=0; s<size_cnt; ++s) {
+            unsigned int age = FifoInserts[s] - stamps[s];
+            if (stamps[s] && age < Sizes[s]) {
+                Fifo[s].hits[age]++;
+            }
+            else {
+                stamps[s] = ++FifoInserts[s];
+                Fifo[s].misses++;
+            }
+        }
+
+        // only vertices known to be on the stack are searched for
+        unsigned char& state = InStack[vert];
+        if (state == OnStack)
+            lru_hits[Stack.find((int)vert)]++;
+        else if (state == Unused)
+            VertsUsed++;
+
+        int evicted;
+        Stack.touch((int)vert, evicted);
+        state = OnStack;
+        if (evicted >= 0) InStack[evicted] = Evicted;
+    }
+
+    // batches take whole triangles
+    for (unsigned int i=0; i+2<idx_cnt; i+=3) {
+        const unsigned int* tri = &indices[i];
+        for (unsigned int s=0; s<size_cnt; ++s) {
+            unsigned int limit = max(Sizes[s], 3u);
+            unsigned int added = 0;
+            for (int k=0; k<3; ++k) {
+                if (BatchStamps[(size_t)tri[k] * size_cnt + s] > BatchStarts[s]) continue;
+                if (k > 0 && tri[k] == tri[0]) continue;
+                if (k > 1 && tri[k] == tri[1]) continue;
+                added++;
+            }
+            if (BatchInserts[s] - BatchStarts[s] + added > limit)
+                BatchStarts[s] = BatchInserts[s];
+
+            for (int k=0; k<3; ++k) {
+                unsigned int& stamp = BatchStamps[(size_t)tri[k] * size_cnt + s];
+                if (stamp > BatchStarts[s]) {
+                    Batch[s].hits[BatchInserts[s] - stamp]++;
+                }
+                else {
+                    stamp = ++BatchInserts[s];
+                    Batch[s].misses++;
+                }
+            }
+        }
+    }
+
+    // inclusion: an LRU of size n holds exactly the n most recent vertices
+    unsigned int tri_count = idx_cnt / 3;
+    for (unsigned int s=0; s<size_cnt; ++s) {
+        unsigned long long hits = 0;
+        for (unsigned int d=0; d<Sizes[s]; ++d) {
+            Lru[s].hits[d] = lru_hits[d];
+            hits += lru_hits[d];
+        }
+        Lru[s].misses = idx_cnt - hits;
+
+        finishStats(Fifo[s], tri_count, VertsUsed);
+        finishStats(Lru[s], tri_count, VertsUsed);
+        finishStats(Batch[s], tri_count, VertsUsed);
+    }
+}
+
+unsigned int analyzer::getCacheCount() const
+{
+    return (unsigned int)Sizes.size();
+}
+
+const analyzer::CacheStats& analyzer::getFifo(unsigned int index) const
+{
+    return Fifo[index];
+}
+
+const analyzer::CacheStats& analyzer::getLru(unsigned int index) const
+{
+    return Lru[index];
+}
+
+const analyzer::CacheStats& analyzer::getBatch(unsigned int index) const
+{
+    return Batch[index];
+}
+
+const analyzer::CacheStats& analyzer::getStats(CacheModel model, unsigned int index) const
+{
+    if (model == FifoModel) return Fifo[index];
+    if (model == BatchModel) return Batch[index];
+    return Lru[index];
+}
+
+unsigned int analyzer::getVertsUsed() const
+{
+    return VertsUsed;
+}
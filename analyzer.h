@@ -0,0 +1,76 @@
+// Measures how well an index list uses FIFO, LRU and batched post transform caches
+
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <vector>
+
+#include "cachemodel.h"
+
+namespace sp
+{
+    // Runs every cache size of both models in a single pass over the indices.
+    // A FIFO lookup is one compare against the time the vertex was put in.
+    // The LRU keeps the MaxCacheSize most recent vertices in one stack, the
+    // position a vertex is found at tells the hits of every size at once.
+    // Batches are stamped like the FIFO, with the insert count each batch
+    // started at. The scratch memory is kept between calls, so one analyzer
+    // can go through a whole batch of meshes.
+    class analyzer
+    {
+    public:
+        enum { MaxCacheSize = 64 };
+
+        struct CacheStats
+        {
+            unsigned int size;
+            unsigned long long misses;
+            float acmr;                     // misses per triangle
+            float atvr;                     // misses per vertex used, 1 is the best possible
+            // hits by where the vertex was found, 0 is the newest entry for
+            // FIFO and batches and the most recently used one for LRU
+            unsigned long long hits[MaxCacheSize];
+        };
+
+        analyzer();
+
+        // sizes go from 1 to MaxCacheSize, 16 and 32 until this is called
+        void setCacheSizes(const unsigned int* sizes, unsigned int count);
+
+        // indices are triangles into [0, vert_cnt)
+        void analyze(const unsigned int* indices, unsigned int idx_cnt, unsigned int vert_cnt);
+
+        unsigned int getCacheCount() const;
+        const CacheStats& getFifo(unsigned int index) const;
+        const CacheStats& getLru(unsigned int index) const;
+        // batches of at most size unique vertices, see BatchCache
+        const CacheStats& getBatch(unsigned int index) const;
+        const CacheStats& getStats(CacheModel model, unsigned int index) const;
+        unsigned int getVertsUsed() const;
+
+    private:
+
+        std::vector<unsigned int> Sizes;
+        std::vector<CacheStats>   Fifo;
+        std::vector<CacheStats>   Lru;
+        std::vector<CacheStats>   Batch;
+        unsigned int              VertsUsed;
+
+        // FIFO: for vertex v and size s, 1 + the insert count of s when v
+        // went in, at [v * Sizes.size() + s]. 0 if it never did.
+        std::vector<unsigned int> FifoStamps;
+        std::vector<unsigned int> FifoInserts;
+
+        // batches: same stamps, a vertex is in the batch when it went in
+        // after BatchStarts
+        std::vector<unsigned int> BatchStamps;
+        std::vector<unsigned int> BatchInserts;
+        std::vector<unsigned int> BatchStarts;
+
+        // LRU: a flag per vertex, so misses never search the stack
+        enum { Unused, OnStack, Evicted };
+        std::vector<unsigned char> InStack;
+        LruCache<MaxCacheSize>    Stack;
+    };
+}
+#endif // ANALYZER_H
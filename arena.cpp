@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "arena.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    size_t alignUp(size_t bytes)
+    {
+        return (bytes + Arena::Alignment - 1) & ~(size_t)(Arena::Alignment - 1);
+    }
+
+    char* newBlock(size_t bytes)
+    {
+        void* block = 0;
+        if (posix_memalign(&block, Arena::Alignment, max(bytes, (size_t)Arena::Alignment)) != 0)
+            return 0;
+        return (char*)block;
+    }
+}
+
+Arena::Arena()
+    : Block(0)
+    , BlockSize(0)
+    , Used(0)
+    , ExtraUsed(0)
+    , Blocks(0)
+{
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+void* Arena::allocBytes(size_t bytes)
+{
+    // empty allocations take an alignment's worth too, so they get a
+    // pointer of their own and null only ever means out of memory
+    bytes = alignUp(max(bytes, (size_t)1));
+    if (Used + bytes > BlockSize) {
+        // doesn't fit, move on to a bigger block. the old one may still be
+        // in use, so it is kept until the next reset.
+        size_t size = max(bytes, max(BlockSize * 2, (size_t)MinBlockSize));
+        char* block = newBlock(size);
+        if (!block) return 0;
+        Blocks++;
+
+        if (Used > 0) {
+            Extra.push_back(Block);
+            ExtraUsed += Used;
+        }
+        else {
+            free(Block);
+        }
+        Block = block;
+        BlockSize = size;
+        Used = 0;
+    }
+
+    void* memory = Block + Used;
+    Used += bytes;
+    return memory;
+}
+
+void Arena::reset()
+{
+    if (!Extra.empty()) {
+        size_t size = Used + ExtraUsed;
+        for (size_t i=0; i<Extra.size(); ++i)
+            free(Extra[i]);
+        Extra.clear();
+
+        // one block for everything the last round needed, plus some room
+        if (size > BlockSize) {
+            free(Block);
+            BlockSize = alignUp(size + size / 4);
+            Block = newBlock(BlockSize);
+            if (!Block) BlockSize = 0;
+            Blocks++;
+        }
+    }
+    Used = 0;
+    ExtraUsed = 0;
+}
+
+void Arena::release()
+{
+    for (size_t i=0; i<Extra.size(); ++i)
+        free(Extra[i]);
+    Extra.clear();
+    free(Block);
+    Block = 0;
+    BlockSize = 0;
+    Used = 0;
+    ExtraUsed = 0;
+}
+
+size_t Arena::capacity() const
+{
+    return BlockSize;
+}
+
+size_t Arena::used() const
+{
+    return Used + ExtraUsed;
+}
+
+unsigned long long Arena::blockCount() const
+{
+    return Blocks;
+}
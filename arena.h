@@ -0,0 +1,59 @@
+// Monotonic allocator for scratch memory that is thrown away all at once
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+namespace sp
+{
+    // alloc only bumps a pointer and reset gives everything back at once
+    // while keeping the memory. When a round needs more than the block
+    // holds, it goes on in a block twice the size, and the next reset folds
+    // everything into one block big enough for the whole round. After the
+    // largest job has been seen, nothing more is allocated.
+    //
+    // Only for trivially copyable types, nothing is constructed or destroyed.
+    class Arena
+    {
+    public:
+        Arena();
+        ~Arena();
+
+        // uninitialized, aligned to Alignment, also for a count of 0.
+        // null when the system allocator fails, callers have to check
+        template <typename T>
+        T* alloc(size_t count)
+        {
+            return (T*)allocBytes(count * sizeof(T));
+        }
+
+        void reset();
+        // frees all of it
+        void release();
+
+        size_t capacity() const;
+        size_t used() const;
+        // blocks taken from the system allocator so far
+        unsigned long long blockCount() const;
+
+        enum { Alignment = 64, MinBlockSize = 64 * 1024 };
+
+    private:
+        Arena(const Arena &);
+        Arena& operator=(const Arena &);
+
+        void* allocBytes(size_t bytes);
+
+        char* Block;
+        size_t BlockSize;
+        size_t Used;
+
+        // blocks taken after Block filled up in this round, and their bytes
+        std::vector<char*> Extra;
+        size_t ExtraUsed;
+        unsigned long long Blocks;
+    };
+}
+#endif // ARENA_H
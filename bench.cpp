@@ -0,0 +1,326 @@
+// Times every step of the optimizer over a set of meshes, and compares the
+// numbers with an earlier run. Built by make bench.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "analyzer.h"
+#include "log.h"
+#include "meshbuffer.h"
+#include "meshfiles.h"
+#include "vcache.h"
+
+using namespace std;
+
+namespace
+{
+    typedef chrono::high_resolution_clock Clock;
+
+    const unsigned int DefaultRepetitions = 5;
+    const double DefaultMaxSlowdown = 0.10;
+    const double DefaultMaxAcmr = 0.0005;
+
+    double median(vector<double> values)
+    {
+        if (values.empty()) return 0.0;
+        sort(values.begin(), values.end());
+        size_t mid = values.size() / 2;
+        return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) * 0.5;
+    }
+
+    // one line of the output, timings are medians over the repetitions
+    struct Row
+    {
+        string mesh;
+        unsigned int tris;
+        unsigned int verts;
+        double load_ms;
+        double init_ms;
+        double score_ms;
+        double loop_ms;
+        double analyze_ms;
+        double tris_per_s;          // init, score and loop together
+        float acmr[3];              // FIFO, LRU and batch, 32 entries
+        long peak_rss_kb;           // of the process that benched this mesh alone
+    };
+
+    const char* Header = "mesh\ttris\tverts\tload_ms\tinit_ms\tscore_ms\tloop_ms\tanalyze_ms\t"
+                         "tris_per_s\tacmr_fifo32\tacmr_lru32\tacmr_batch32\tpeak_rss_kb";
+    const char* AcmrNames[3] = { "FIFO 32", "LRU 32", "batch 32" };
+
+    void writeRow(FILE* out, const Row& row)
+    {
+        fprintf(out, "%s\t%u\t%u\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.0f\t%.4f\t%.4f\t%.4f\t%ld\n",
+                row.mesh.c_str(), row.tris, row.verts, row.load_ms, row.init_ms, row.score_ms,
+                row.loop_ms, row.analyze_ms, row.tris_per_s, row.acmr[0], row.acmr[1], row.acmr[2],
+                row.peak_rss_kb);
+    }
+
+    // one line of what writeRow wrote, false for the header or a broken line
+    bool parseRow(const char* line, Row& row)
+    {
+        if (strncmp(line, "mesh\t", 5) == 0) return false;
+
+        const char* tab = strchr(line, '\t');
+        if (!tab) return false;
+
+        row.mesh.assign(line, tab - line);
+        return sscanf(tab + 1, "%u %u %lf %lf %lf %lf %lf %lf %f %f %f %ld", &row.tris, &row.verts,
+                      &row.load_ms, &row.init_ms, &row.score_ms, &row.loop_ms, &row.analyze_ms,
+                      &row.tris_per_s, &row.acmr[0], &row.acmr[1], &row.acmr[2], &row.peak_rss_kb) == 12;
+    }
+
+    bool readRows(const char* path, vector<Row>& rows)
+    {
+        FILE* in_file = fopen(path, "r");
+        if (!in_file) return false;
+
+        char line[4096];
+        Row row;
+        while (fgets(line, sizeof(line), in_file)) {
+            if (parseRow(line, row))
+                rows.push_back(row);
+        }
+        fclose(in_file);
+        return true;
+    }
+
+    bool benchMesh(const string& input, unsigned int repetitions, unsigned int threads, Row& row)
+    {
+        sp::vcache optimizer;
+        optimizer.setThreads(threads);
+        sp::analyzer analyzer;
+        unsigned int size = 32;
+        analyzer.setCacheSizes(&size, 1);
+
+        vector<double> load, init, score, loop, analyze;
+        MeshBuffer buffer;
+        for (unsigned int r=0; r<repetitions; ++r) {
+            Clock::time_point start = Clock::now();
+            if (!sp::loadMesh(buffer, input)) {
+                fprintf(stderr, "[!] %s has no triangles, skipped\n", input.c_str());
+                return false;
+            }
+            load.push_back(sp::elapsedMs(start));
+
+            optimizer.optimize(buffer.getIndexData(), buffer.getIdxCnt(), buffer.getVertCnt());
+            if (optimizer.getIndexCount() != buffer.getIdxCnt()) {
+                fprintf(stderr, "[!] %s couldn't be optimized, skipped\n", input.c_str());
+                return false;
+            }
+            const sp::PhaseTimes& times = optimizer.getPhaseTimes();
+            init.push_back(times.init_ms);
+            score.push_back(times.score_ms);
+            loop.push_back(times.loop_ms);
+
+            start = Clock::now();
+            analyzer.analyze(optimizer.getIndices(), optimizer.getIndexCount(), buffer.getVertCnt());
+            analyze.push_back(sp::elapsedMs(start));
+        }
+
+        row.mesh = input;
+        row.tris = buffer.getIdxCnt() / 3;
+        row.verts = buffer.getVertCnt();
+        row.load_ms = median(load);
+        row.init_ms = median(init);
+        row.score_ms = median(score);
+        row.loop_ms = median(loop);
+        row.analyze_ms = median(analyze);
+
+        double optimize_ms = row.init_ms + row.score_ms + row.loop_ms;
+        row.tris_per_s = optimize_ms > 0.0 ? row.tris / (optimize_ms * 0.001) : 0.0;
+
+        // every repetition gives the same order, the last one is measured
+        row.acmr[0] = analyzer.getFifo(0).acmr;
+        row.acmr[1] = analyzer.getLru(0).acmr;
+        row.acmr[2] = analyzer.getBatch(0).acmr;
+        row.peak_rss_kb = 0;
+        return true;
+    }
+
+    // runs benchMesh in a child process, so the peak RSS of the child is
+    // what this mesh needs rather than the most any mesh so far needed.
+    // the row comes back through a pipe, in writeRow's format.
+    bool benchMeshForked(const string& input, unsigned int repetitions, unsigned int threads, Row& row)
+    {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            fprintf(stderr, "[!] Can't create a pipe for %s\n", input.c_str());
+            return false;
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "[!] Can't start a process for %s\n", input.c_str());
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+
+        if (pid == 0) {
+            close(fds[0]);
+            bool ok = benchMesh(input, repetitions, threads, row);
+            if (ok) {
+                FILE* out = fdopen(fds[1], "w");
+                writeRow(out, row);
+                fclose(out);
+            }
+            _exit(ok ? 0 : 1);
+        }
+
+        close(fds[1]);
+        FILE* in = fdopen(fds[0], "r");
+        char line[4096];
+        bool ok = fgets(line, sizeof(line), in) && parseRow(line, row);
+        fclose(in);
+
+        int status = 0;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return false;
+        row.peak_rss_kb = usage.ru_maxrss;
+        return ok;
+    }
+
+    // true when nothing got slower than max_slowdown or worse than max_acmr
+    bool compareRows(const vector<Row>& rows, const vector<Row>& baseline,
+                     double max_slowdown, double max_acmr)
+    {
+        bool ok = true;
+        for (size_t i=0; i<rows.size(); ++i) {
+            const Row& row = rows[i];
+            const Row* base = 0;
+            for (size_t j=0; j<baseline.size() && !base; ++j)
+                if (baseline[j].mesh == row.mesh) base = &baseline[j];
+            if (!base) {
+                fprintf(stderr, "[-] %s: not in the baseline\n", row.mesh.c_str());
+                continue;
+            }
+
+            double change = base->tris_per_s > 0.0 ? row.tris_per_s / base->tris_per_s - 1.0 : 0.0;
+            if (change < -max_slowdown) {
+                fprintf(stderr, "[!] %s: %.0f -> %.0f tris/s (%+.1f%%)\n", row.mesh.c_str(),
+                        base->tris_per_s, row.tris_per_s, change * 100.0);
+                ok = false;
+            }
+
+            for (int k=0; k<3; ++k) {
+                if (row.acmr[k] > base->acmr[k] + max_acmr) {
+                    fprintf(stderr, "[!] %s: %s ACMR %.4f -> %.4f\n", row.mesh.c_str(), AcmrNames[k],
+                            base->acmr[k], row.acmr[k]);
+                    ok = false;
+                }
+            }
+        }
+        return ok;
+    }
+
+    void printLog(sp::LogLevel level, const char* message, void*)
+    {
+        if (level != sp::LogInfo) fprintf(stderr, "[!] %s\n", message);
+    }
+
+    void usage(const char* name)
+    {
+        printf("usage: %s [-r repetitions] [-j threads] [-o out.tsv] [--baseline old.tsv\n"
+               "       [--max-slowdown ratio] [--max-acmr delta]] [mesh|dir]...\n"
+               "  optimizes every mesh given (models/ by default) repetitions times\n"
+               "  (default %u) and writes one tab separated line per mesh with the\n"
+               "  median time of every step, the tris/s of the optimizer, the FIFO,\n"
+               "  LRU and batch ACMR for 32 entries and the peak RSS. Every mesh runs\n"
+               "  in a process of its own, so the RSS is what that mesh needed.\n"
+               "  -j sets the threads building the adjacency (1 by default, 0 for\n"
+               "  one per core), see vcache::setThreads.\n"
+               "  --baseline compares the run with an earlier output and exits with 1\n"
+               "  when a mesh is slower by more than --max-slowdown (default %.2f) or\n"
+               "  an ACMR is higher by more than --max-acmr (default %.4f).\n",
+               name, DefaultRepetitions, DefaultMaxSlowdown, DefaultMaxAcmr);
+    }
+}
+
+int main(int argc, char** argv) {
+
+    unsigned int repetitions = DefaultRepetitions;
+    unsigned int threads = 1;
+    const char* out_path = 0;
+    const char* baseline_path = 0;
+    double max_slowdown = DefaultMaxSlowdown;
+    double max_acmr = DefaultMaxAcmr;
+    vector<string> files;
+
+    // before the inputs are collected, which logs the paths it can't open
+    sp::setLogCallback(printLog, 0);
+
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repetitions = max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-slowdown") == 0 && i + 1 < argc) {
+            max_slowdown = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-acmr") == 0 && i + 1 < argc) {
+            max_acmr = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        }
+        else {
+            sp::collectInputs(argv[i], files);
+        }
+    }
+    if (files.empty()) sp::collectInputs("models", files);
+    if (files.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vector<Row> baseline;
+    if (baseline_path && !readRows(baseline_path, baseline)) {
+        fprintf(stderr, "[!] Can't read %s\n", baseline_path);
+        return 1;
+    }
+
+    FILE* out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "[!] Can't write %s\n", out_path);
+        return 1;
+    }
+
+    vector<Row> rows;
+    fprintf(out, "%s\n", Header);
+    for (size_t i=0; i<files.size(); ++i) {
+        Row row;
+        if (!benchMeshForked(files[i], repetitions, threads, row))
+            continue;
+        writeRow(out, row);
+        fflush(out);
+        rows.push_back(row);
+    }
+    if (out != stdout) fclose(out);
+
+    if (!baseline_path) return 0;
+    if (!compareRows(rows, baseline, max_slowdown, max_acmr)) return 1;
+    fprintf(stderr, "[-] No regressions against %s\n", baseline_path);
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Post transform cache models the optimizer can be run against
+
+#ifndef CACHE_MODEL_H
+#define CACHE_MODEL_H
+
+#include <assert.h>
+#include <string.h> // for memmove
+
+#include "lrucache.h"
+
+namespace sp
+{
+    // LruModel    a vertex moves to the front every time it is used
+    // FifoModel   a vertex goes in at the front on a miss and stays put on
+    //             a hit, so it leaves after a fixed number of misses
+    // BatchModel  triangles are gathered into batches of a limited number
+    //             of unique vertices, like a GPU filling a warp. Vertices
+    //             are shared within a batch and never between batches.
+    enum CacheModel { LruModel, FifoModel, BatchModel };
+
+    // Every model is a class with the same members as LruCache, so vcache
+    // can take it as a template argument:
+    //
+    //   void setLimit(int limit), void clear(), int size() const
+    //   int operator[](int pos) const     newest entry at 0
+    //   int find(int vert) const          position of vert or -1
+    //   int addTriangle(const int* verts, int* evicted, int& evicted_count)
+    //
+    // addTriangle returns how many leading entries changed position and
+    // writes the vertices that left the cache to evicted, which needs room
+    // for Capacity + 3 entries.
+
+    template <int Capacity>
+    class FifoCache
+    {
+    public:
+        FifoCache()
+            : Size(0)
+            , Limit(Capacity)
+        {
+        }
+
+        void setLimit(int limit)
+        {
+            assert(limit > 0 && limit <= Capacity);
+            Limit = limit;
+            if (Size > Limit) Size = Limit;
+        }
+
+        void clear()
+        {
+            Size = 0;
+        }
+
+        int size() const
+        {
+            return Size;
+        }
+
+        int operator[](int pos) const
+        {
+            return Entries[pos];
+        }
+
+        int find(int vert) const
+        {
+            for (int i=0; i<Size; ++i)
+                if (Entries[i] == vert) return i;
+            return -1;
+        }
+
+        int addTriangle(const int* verts, int* evicted, int& evicted_count)
+        {
+            int changed = 0;
+            evicted_count = 0;
+            for (int i=0; i<3; ++i) {
+                if (find(verts[i]) >= 0) continue;
+
+                if (Size < Limit)
+                    Size++;
+                else
+                    evicted[evicted_count++] = Entries[Size - 1];
+
+                memmove(&Entries[1], &Entries[0], (Size - 1) * sizeof(int));
+                Entries[0] = verts[i];
+                changed = Size;
+            }
+            return changed;
+        }
+
+    private:
+        int Entries[Capacity];
+        int Size;
+        int Limit;
+    };
+
+    // the limit is the number of unique vertices per batch. a triangle that
+    // would take the batch past it starts the next one, so limits under 3
+    // act as 3.
+    template <int Capacity>
+    class BatchCache
+    {
+    public:
+        BatchCache()
+            : Size(0)
+            , Limit(Capacity)
+        {
+        }
+
+        void setLimit(int limit)
+        {
+            assert(limit > 0 && limit <= Capacity);
+            Limit = limit < 3 ? 3 : limit;
+            if (Size > Limit) Size = 0;
+        }
+
+        void clear()
+        {
+            Size = 0;
+        }
+
+        int size() const
+        {
+            return Size;
+        }
+
+        int operator[](int pos) const
+        {
+            return Entries[pos];
+        }
+
+        int find(int vert) const
+        {
+            for (int i=0; i<Size; ++i)
+                if (Entries[i] == vert) return i;
+            return -1;
+        }
+
+        int addTriangle(const int* verts, int* evicted, int& evicted_count)
+        {
+            evicted_count = 0;
+
+            // a degenerate triangle can use the same new vertex twice
+            int added = 0;
+            for (int i=0; i<3; ++i) {
+                if (find(verts[i]) >= 0) continue;
+                if (i > 0 && verts[i] == verts[0]) continue;
+                if (i > 1 && verts[i] == verts[1]) continue;
+                added++;
+            }
+            if (added == 0) return 0;
+
+            if (Size + added > Limit) {
+                for (int i=0; i<Size; ++i)
+                    evicted[evicted_count++] = Entries[i];
+                Size = 0;
+            }
+
+            for (int i=0; i<3; ++i) {
+                if (find(verts[i]) >= 0) continue;
+                memmove(&Entries[1], &Entries[0], Size * sizeof(int));
+                Entries[0] = verts[i];
+                Size++;
+            }
+            return Size;
+        }
+
+    private:
+        int Entries[Capacity];
+        int Size;
+        int Limit;
+    };
+}
+#endif // CACHE_MODEL_H
@@ -0,0 +1,310 @@
+#include "indexcodec.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    // first byte of the stream, the low nibble is the version
+    const unsigned char Header = 0xe0;
+
+    enum
+    {
+        FifoSize = 16,
+        FifoMask = FifoSize - 1,
+
+        // low nibble of a code byte
+        CodeNext = 0,           // the next vertex not seen yet
+        CodeFifo = 1,           // 1..14, vertex FIFO slot code - CodeFifo
+        CodeExplicit = 15,      // varint in the data
+
+        // high nibble, edge FIFO slot or no edge at all
+        EdgeNone = 15,
+
+        // varints of a triangle without an edge, past the FIFO slots
+        CornerExplicit = 1 + FifoSize
+    };
+
+    struct Edge
+    {
+        unsigned int a;
+        unsigned int b;
+    };
+
+    // FIFO of the last FifoSize entries, slot 0 is the newest
+    template <typename T>
+    struct Fifo
+    {
+        T entries[FifoSize];
+        unsigned int offset;
+
+        void clear(const T& empty)
+        {
+            for (int i=0; i<FifoSize; ++i) entries[i] = empty;
+            offset = 0;
+        }
+
+        void push(const T& value)
+        {
+            entries[offset] = value;
+            offset = (offset + 1) & FifoMask;
+        }
+
+        const T& operator[](unsigned int slot) const
+        {
+            return entries[(offset - 1 - slot) & FifoMask];
+        }
+    };
+
+    void pushVarint(vector<unsigned char>& data, unsigned int value)
+    {
+        while (value >= 0x80) {
+            data.push_back((unsigned char)(value | 0x80));
+            value >>= 7;
+        }
+        data.push_back((unsigned char)value);
+    }
+
+    bool readVarint(const unsigned char*& p, const unsigned char* end, unsigned int& value)
+    {
+        value = 0;
+        for (int shift=0; shift<35; shift+=7) {
+            if (p == end) return false;
+            unsigned char byte = *p++;
+            value |= (unsigned int)(byte & 0x7f) << shift;
+            if (byte < 0x80) return true;
+        }
+        return false;
+    }
+
+    // small steps either way become small numbers
+    unsigned int zigzag(unsigned int value, unsigned int last)
+    {
+        int delta = (int)(value - last);
+        return ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31);
+    }
+
+    unsigned int unzigzag(unsigned int code, unsigned int last)
+    {
+        return last + ((code >> 1) ^ (0u - (code & 1)));
+    }
+
+    int findVertex(const Fifo<unsigned int>& fifo, unsigned int vert, int slots)
+    {
+        for (int i=0; i<slots; ++i)
+            if (fifo[i] == vert) return i;
+        return -1;
+    }
+
+    // encoder and decoder keep the exact same state, one triangle at a time
+    struct State
+    {
+        Fifo<Edge> edges;
+        Fifo<unsigned int> verts;
+        unsigned int next;
+        unsigned int last;
+
+        // empty slots hold ~0, which never matches a vertex
+        void clear()
+        {
+            Edge empty = { ~0u, ~0u };
+            edges.clear(empty);
+            verts.clear(~0u);
+            next = 0;
+            last = 0;
+        }
+
+        void pushEdge(unsigned int a, unsigned int b)
+        {
+            Edge edge = { a, b };
+            edges.push(edge);
+        }
+
+        // the edges a neighbour of a, b, c would share, reversed
+        void pushEdges(unsigned int a, unsigned int b, unsigned int c)
+        {
+            pushEdge(b, a);
+            pushEdge(c, b);
+            pushEdge(a, c);
+        }
+    };
+
+    // one corner of a triangle without a shared edge
+    void encodeCorner(State& state, unsigned int vert, vector<unsigned char>& data)
+    {
+        int slot = findVertex(state.verts, vert, FifoSize);
+        if (vert == state.next) {
+            pushVarint(data, 0);
+            state.next++;
+        }
+        else if (slot >= 0) {
+            pushVarint(data, 1 + slot);
+            return;
+        }
+        else {
+            pushVarint(data, CornerExplicit + zigzag(vert, state.last));
+            state.last = vert;
+        }
+        state.verts.push(vert);
+    }
+
+    bool decodeCorner(State& state, const unsigned char*& p, const unsigned char* end, unsigned int& vert)
+    {
+        unsigned int code;
+        if (!readVarint(p, end, code)) return false;
+
+        if (code == 0) {
+            vert = state.next++;
+        }
+        else if (code < CornerExplicit) {
+            vert = state.verts[code - 1];
+            return true;
+        }
+        else {
+            vert = unzigzag(code - CornerExplicit, state.last);
+            state.last = vert;
+        }
+        state.verts.push(vert);
+        return true;
+    }
+}
+
+void sp::encodeIndices(const unsigned int* indices, unsigned int idx_cnt, vector<unsigned char>& data)
+{
+    unsigned int tri_count = idx_cnt / 3;
+
+    data.clear();
+    data.push_back(Header);
+    pushVarint(data, tri_count * 3);
+
+    // the codes come first, one byte per triangle, and the varints after
+    size_t codes = data.size();
+    data.resize(codes + tri_count);
+
+    State state;
+    state.clear();
+
+    for (unsigned int i=0; i<tri_count; ++i) {
+        const unsigned int* tri = indices + i * 3;
+
+        // the newest edge shared with one of the last triangles, rotated to a, b
+        int edge = -1;
+        int rotation = 0;
+        for (int slot=0; slot<EdgeNone && edge < 0; ++slot) {
+            const Edge& e = state.edges[slot];
+            for (int r=0; r<3; ++r) {
+                if (e.a == tri[r] && e.b == tri[(r + 1) % 3]) {
+                    edge = slot;
+                    rotation = r;
+                    break;
+                }
+            }
+        }
+
+        unsigned int a = tri[rotation];
+        unsigned int b = tri[(rotation + 1) % 3];
+        unsigned int c = tri[(rotation + 2) % 3];
+
+        if (edge < 0) {
+            data[codes + i] = (unsigned char)(EdgeNone << 4);
+            encodeCorner(state, a, data);
+            encodeCorner(state, b, data);
+            encodeCorner(state, c, data);
+            state.pushEdges(a, b, c);
+            continue;
+        }
+
+        int code;
+        int slot = findVertex(state.verts, c, CodeExplicit - CodeFifo);
+        if (c == state.next) {
+            code = CodeNext;
+            state.next++;
+            state.verts.push(c);
+        }
+        else if (slot >= 0) {
+            code = CodeFifo + slot;
+        }
+        else {
+            code = CodeExplicit;
+            pushVarint(data, zigzag(c, state.last));
+            state.last = c;
+            state.verts.push(c);
+        }
+
+        data[codes + i] = (unsigned char)((edge << 4) | code);
+        state.pushEdge(c, b);
+        state.pushEdge(a, c);
+    }
+}
+
+unsigned int sp::getEncodedIndexCount(const unsigned char* data, size_t size)
+{
+    if (size < 2 || data[0] != Header) return 0;
+
+    const unsigned char* p = data + 1;
+    unsigned int idx_cnt;
+    if (!readVarint(p, data + size, idx_cnt)) return 0;
+    return idx_cnt;
+}
+
+bool sp::decodeIndices(unsigned int* indices, unsigned int idx_cnt, const unsigned char* data, size_t size)
+{
+    const unsigned char* end = data + size;
+    if (size < 2 || data[0] != Header) return false;
+
+    const unsigned char* p = data + 1;
+    unsigned int stored;
+    if (!readVarint(p, end, stored) || stored != idx_cnt || idx_cnt % 3 != 0) return false;
+
+    unsigned int tri_count = idx_cnt / 3;
+    if ((size_t)(end - p) < tri_count) return false;
+    const unsigned char* codes = p;
+    p += tri_count;
+
+    State state;
+    state.clear();
+
+    for (unsigned int i=0; i<tri_count; ++i) {
+        unsigned int* tri = indices + i * 3;
+        unsigned int code = codes[i];
+        unsigned int edge = code >> 4;
+
+        if (edge == EdgeNone) {
+            if (!decodeCorner(state, p, end, tri[0]) ||
+                !decodeCorner(state, p, end, tri[1]) ||
+                !decodeCorner(state, p, end, tri[2]))
+                return false;
+            state.pushEdges(tri[0], tri[1], tri[2]);
+            continue;
+        }
+
+        const Edge& e = state.edges[edge];
+        unsigned int a = e.a;
+        unsigned int b = e.b;
+        unsigned int c;
+
+        code &= 15;
+        if (code == CodeNext) {
+            c = state.next++;
+            state.verts.push(c);
+        }
+        else if (code < CodeExplicit) {
+            c = state.verts[code - CodeFifo];
+        }
+        else {
+            unsigned int delta;
+            if (!readVarint(p, end, delta)) return false;
+            c = unzigzag(delta, state.last);
+            state.last = c;
+            state.verts.push(c);
+        }
+
+        tri[0] = a;
+        tri[1] = b;
+        tri[2] = c;
+        state.pushEdge(c, b);
+        state.pushEdge(a, c);
+    }
+
+    return p == end;
+}
@@ -0,0 +1,33 @@
+// Compresses optimized index lists by what the last triangles already used
+
+#ifndef INDEX_CODEC_H
+#define INDEX_CODEC_H
+
+#include <cstddef>
+#include <vector>
+
+namespace sp
+{
+    // Every triangle is one code byte. The high nibble is where in a FIFO
+    // of the last 16 edges the triangle finds one of its own edges, and the
+    // low nibble says where the third vertex comes from: the next vertex not
+    // seen yet, a slot in a FIFO of the last 16 vertices, or a varint in the
+    // data that follows the codes. Triangles with no recent edge spend a
+    // varint on each corner.
+    //
+    // After vcache::optimize nearly every triangle shares an edge with one
+    // just before it, and after optimizeVertexFetch new vertices come in
+    // order, so most triangles cost the code byte alone.
+    //
+    // Triangle order and winding are kept, but a triangle may come back
+    // rotated to start at a different corner.
+    void encodeIndices(const unsigned int* indices, unsigned int idx_cnt, std::vector<unsigned char>& data);
+
+    // index count stored in data, 0 if data isn't an encoded index list
+    unsigned int getEncodedIndexCount(const unsigned char* data, size_t size);
+
+    // writes getEncodedIndexCount(data, size) indices. nothing is
+    // allocated, false if data is malformed or idx_cnt doesn't match.
+    bool decodeIndices(unsigned int* indices, unsigned int idx_cnt, const unsigned char* data, size_t size);
+}
+#endif // INDEX_CODEC_H
@@ -0,0 +1,30 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "log.h"
+
+namespace
+{
+    sp::LogCallback Callback = 0;
+    void* CallbackUser = 0;
+}
+
+void sp::setLogCallback(LogCallback callback, void* user)
+{
+    Callback = callback;
+    CallbackUser = user;
+}
+
+void sp::logMessage(LogLevel level, const char* format, ...)
+{
+    if (!Callback) return;
+
+    // longer messages are cut, none of the library's come close
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    Callback(level, message, CallbackUser);
+}
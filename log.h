@@ -0,0 +1,26 @@
+// Where the library's messages and progress reports go
+
+#ifndef LOG_H
+#define LOG_H
+
+namespace sp
+{
+    enum LogLevel { LogInfo, LogWarning, LogError };
+
+    // message has no trailing newline. It is called on whichever thread
+    // logged, so it has to be thread safe when meshes are worked on side by
+    // side.
+    typedef void (*LogCallback)(LogLevel level, const char* message, void* user);
+
+    // done goes from 0 to 1, and is exactly 1 on the last call
+    typedef void (*ProgressCallback)(float done, void* user);
+
+    // Nothing is printed until a callback is set, and a null callback
+    // silences the library again. Set it before starting any work, it is
+    // not synchronized with the threads logging.
+    void setLogCallback(LogCallback callback, void* user);
+
+    // printf style, nothing is formatted while no callback is set
+    void logMessage(LogLevel level, const char* format, ...);
+}
+#endif // LOG_H
@@ -0,0 +1,98 @@
+// Fixed size LRU used to model the post transform cache
+
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <assert.h>
+#include <string.h> // for memmove
+
+namespace sp
+{
+    // Holds up to Capacity vertex indices, most recently used at position 0.
+    // The storage lives inside the object, so nothing is allocated while
+    // the optimizer runs. The active size can be lowered at runtime with
+    // setLimit, Capacity is only the upper bound.
+    template <int Capacity>
+    class LruCache
+    {
+    public:
+        LruCache()
+            : Size(0)
+            , Limit(Capacity)
+        {
+        }
+
+        void setLimit(int limit)
+        {
+            assert(limit > 0 && limit <= Capacity);
+            Limit = limit;
+            if (Size > Limit) Size = Limit;
+        }
+
+        void clear()
+        {
+            Size = 0;
+        }
+
+        int size() const
+        {
+            return Size;
+        }
+
+        int operator[](int pos) const
+        {
+            return Entries[pos];
+        }
+
+        int find(int vert) const
+        {
+            for (int i=0; i<Size; ++i)
+                if (Entries[i] == vert) return i;
+            return -1;
+        }
+
+        // moves vert to the front, shifting everything in front of its old
+        // spot down by one. returns how many leading entries changed
+        // position, and writes the vertex that fell off the end to evicted
+        // (or -1 if nothing was evicted).
+        int touch(int vert, int& evicted)
+        {
+            evicted = -1;
+            int pos = find(vert);
+            if (pos < 0) {
+                if (Size < Limit) {
+                    pos = Size++;
+                }
+                else {
+                    pos = Size - 1;
+                    evicted = Entries[pos];
+                }
+            }
+
+            memmove(&Entries[1], &Entries[0], pos * sizeof(int));
+            Entries[0] = vert;
+            return pos + 1;
+        }
+
+        // the cache model interface, see cachemodel.h. evicted needs room
+        // for three entries.
+        int addTriangle(const int* verts, int* evicted, int& evicted_count)
+        {
+            int changed = 0;
+            evicted_count = 0;
+            for (int i=0; i<3; ++i) {
+                int dropped;
+                int moved = touch(verts[i], dropped);
+                if (moved > changed) changed = moved;
+                if (dropped >= 0) evicted[evicted_count++] = dropped;
+            }
+            return changed;
+        }
+
+    private:
+        int Entries[Capacity];
+        int Size;
+        int Limit;
+    };
+}
+#endif // LRU_CACHE_H
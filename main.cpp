@@ -1,10 +1,685 @@
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "analyzer.h"
+#include "indexcodec.h"
+#include "log.h"
+#include "meshfiles.h"
+#include "overdraw.h"
+#include "parallel.h"
+#include "stream.h"
+#include "submesh.h"
+#include "tune.h"
 #include "vcache.h"
+#include "vertexfetch.h"
+
+using namespace std;
+
+namespace
+{
+    typedef chrono::high_resolution_clock Clock;
+
+    // models/art.obj -> <out_dir>/art<suffix>
+    string outputPath(const string& input, const string& out_dir, const char* suffix)
+    {
+        size_t slash = input.find_last_of('/');
+        string dir = slash == string::npos ? string() : input.substr(0, slash + 1);
+        string name = slash == string::npos ? input : input.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+        if (dot != string::npos) name = name.substr(0, dot);
+
+        if (!out_dir.empty()) dir = out_dir + "/";
+        return dir + name + suffix;
+    }
+
+    // models/art.obj -> <out_dir>/art.obj.spmb, the extension stays so that
+    // art.obj and art.stl don't share a cache
+    string cachePath(const string& input, const string& out_dir)
+    {
+        if (out_dir.empty()) return input + ".spmb";
+
+        size_t slash = input.find_last_of('/');
+        string name = slash == string::npos ? input : input.substr(slash + 1);
+        return out_dir + "/" + name + ".spmb";
+    }
+
+    // true when path exists and was written after source
+    bool isNewer(const string& path, const string& source)
+    {
+        struct stat info, source_info;
+        if (stat(path.c_str(), &info) != 0) return false;
+        if (stat(source.c_str(), &source_info) != 0) return true;
+        return info.st_mtime >= source_info.st_mtime;
+    }
+
+    bool writeObj(const string& path, const MeshBuffer& buffer, const unsigned int* indices, unsigned int count)
+    {
+        FILE* out_file = fopen(path.c_str(), "w");
+        if (!out_file) return false;
+
+        const glm::vec3* verts = buffer.getVertData();
+        for (unsigned int i=0; i<buffer.getVertCnt(); ++i)
+            fprintf(out_file, "v %g %g %g\n", verts[i][0], verts[i][1], verts[i][2]);
+
+        // faces start at 1, not 0
+        for (unsigned int i=0; i+2<count; i+=3)
+            fprintf(out_file, "f %u %u %u\n", indices[i] + 1, indices[i + 1] + 1, indices[i + 2] + 1);
+
+        return fclose(out_file) == 0;
+    }
+
+    // one group per sub-mesh, each with its own copy of the vertices it uses
+    bool writeSubMeshObj(const string& path, const MeshBuffer& buffer, const vector<uint16_t>& local,
+                         const vector<unsigned int>& verts, const vector<sp::SubMesh>& subs)
+    {
+        FILE* out_file = fopen(path.c_str(), "w");
+        if (!out_file) return false;
+
+        const glm::vec3* positions = buffer.getVertData();
+        for (size_t s=0; s<subs.size(); ++s) {
+            const sp::SubMesh& sub = subs[s];
+            fprintf(out_file, "g sub%u\n", (unsigned int)s);
+            for (unsigned int i=0; i<sub.vert_count; ++i) {
+                const glm::vec3& p = positions[verts[sub.first_vert + i]];
+                fprintf(out_file, "v %g %g %g\n", p[0], p[1], p[2]);
+            }
+
+            // faces start at 1, not 0
+            const uint16_t* tri = &local[sub.first_index];
+            unsigned int base = sub.first_vert + 1;
+            for (unsigned int i=0; i+2<sub.index_count; i+=3)
+                fprintf(out_file, "f %u %u %u\n", base + tri[i], base + tri[i + 1], base + tri[i + 2]);
+        }
+
+        return fclose(out_file) == 0;
+    }
+
+    // vertices the split gave to more than one sub-mesh. counted rather
+    // than taken from the vertex count, since the buffer may hold vertices
+    // no triangle uses
+    unsigned int repeatedVerts(const vector<unsigned int>& sub_verts, unsigned int vert_cnt)
+    {
+        vector<bool> seen(vert_cnt, false);
+        unsigned int repeated = 0;
+        for (size_t i=0; i<sub_verts.size(); ++i) {
+            if (seen[sub_verts[i]]) repeated++;
+            seen[sub_verts[i]] = true;
+        }
+        return repeated;
+    }
+
+    struct Batch
+    {
+        vector<string> files;
+        string out_dir;
+
+        // --cache keeps a <name>.<ext>.spmb binary copy of every input next to
+        // the output, and loads that instead of the text file when it is newer
+        bool use_cache;
+
+        // --split runs one mesh at a time with its clusters spread over the threads
+        bool split;
+        sp::ParallelOptions parallel;
+
+        // --overdraw sorts the clusters of the result to draw outer ones first
+        bool overdraw;
+        sp::OverdrawOptions overdraw_options;
+
+        // --fetch renumbers the vertices in the order the result uses them
+        bool fetch;
+
+        // --stream optimizes .obj files a window at a time without loading them
+        bool stream;
+        sp::StreamOptions stream_options;
+
+        // --index16 cuts the result into sub-meshes with 16-bit indices
+        bool index16;
+
+        // --compress also writes the result as a compressed <name>.vcache.idxz
+        bool compress;
+
+        // --stats reports FIFO, LRU and batch cache use of the input and the result
+        bool stats;
+
+        // --params replaces the scoring constants of every optimizer,
+        // --model the cache they optimize for
+        sp::VcacheParams params;
+
+        // --tune searches the params that suit the given cache best over all
+        // the meshes instead of optimizing them
+        bool tune;
+        sp::TuneOptions tune_options;
+
+        // threads every optimize builds its adjacency with, the ones left
+        // over when -j is more than the meshes given
+        unsigned int setup_threads;
+
+        // every option the result depends on, stored beside it in the cache
+        vector<uint32_t> result_key;
+
+        // threads every worker parses an .obj with, the workers share the
+        // cores instead of each starting one thread per core
+        unsigned int load_threads;
+
+        atomic<size_t> next;
+        atomic<unsigned long long> triangles;
+        mutex print_lock;
+    };
+
+    void streamMesh(Batch* batch, const string& input)
+    {
+        Clock::time_point start = Clock::now();
+        string output = outputPath(input, batch->out_dir, ".vcache.obj");
+
+        sp::StreamResult result;
+        bool ok = sp::hasExtension(input, ".obj") &&
+                  sp::optimizeStream(input.c_str(), output.c_str(), batch->stream_options, result);
+        double wall_ms = sp::elapsedMs(start);
+
+        lock_guard<mutex> lock(batch->print_lock);
+        if (!ok) {
+            fprintf(stderr, "[!] Couldn't stream %s to %s, only .obj files can be streamed\n",
+                    input.c_str(), output.c_str());
+            return;
+        }
+
+        batch->triangles += result.triangles;
+        printf("[-] %s: %llu tris in %llu windows, wall %.2f ms (%.0f tris/s)\n", input.c_str(),
+               result.triangles, result.windows, wall_ms,
+               wall_ms > 0.0 ? result.triangles / (wall_ms * 0.001) : 0.0);
+        if (result.skipped)
+            fprintf(stderr, "[!] %s: skipped %llu faces with bad indices\n", input.c_str(), result.skipped);
+    }
+
+    // the per mesh lines are printed here, only the library's problems get through
+    void printLog(sp::LogLevel level, const char* message, void* user)
+    {
+        if (level == sp::LogInfo) return;
+
+        lock_guard<mutex> lock(*(mutex*)user);
+        fprintf(stderr, "[!] %s\n", message);
+    }
+
+    // options that only matter with their pass turned on are left at 0, so
+    // changing them alone still reuses a cache
+    void resultKey(const Batch& batch, vector<uint32_t>& key)
+    {
+        const sp::VcacheParams& params = batch.params;
+        float values[] = { params.cache_decay_power, params.last_tri_score, params.valence_boost_scale,
+                           params.valence_boost_power,
+                           batch.split ? batch.parallel.acmr_tolerance : 0.0f,
+                           batch.overdraw ? batch.overdraw_options.threshold : 0.0f };
+        key.resize(sizeof(values) / sizeof(values[0]));
+        memcpy(&key[0], values, sizeof(values));
+
+        key.push_back((uint32_t)params.max_size_cache);
+        key.push_back((uint32_t)params.cache_model);
+        // the clusters follow the thread count
+        key.push_back(batch.split ? batch.parallel.threads : 0);
+        key.push_back(batch.split ? batch.parallel.min_cluster_tris : 0);
+        key.push_back(batch.overdraw ? batch.overdraw_options.cache_size : 0);
+        key.push_back(batch.fetch);
+    }
+
+    // the order a cache holds, when it was made with the same options
+    bool cachedResult(const MeshBuffer& buffer, const vector<uint32_t>& key, vector<unsigned int>& result)
+    {
+        MeshBuffer::BinSection settings = buffer.getBinExtra(MeshBuffer::OptimizedSettings);
+        MeshBuffer::BinSection order = buffer.getBinExtra(MeshBuffer::OptimizedIndices);
+        if (settings.count != key.size() || order.count != buffer.getIdxCnt()) return false;
+        if (!equal(key.begin(), key.end(), settings.data)) return false;
+
+        result.assign(order.data, order.data + order.count);
+        return true;
+    }
+
+    bool parseCacheModel(const char* arg, sp::CacheModel& model)
+    {
+        if (strcasecmp(arg, "lru") == 0) model = sp::LruModel;
+        else if (strcasecmp(arg, "fifo") == 0) model = sp::FifoModel;
+        else if (strcasecmp(arg, "batch") == 0) model = sp::BatchModel;
+        else return false;
+        return true;
+    }
+
+    const char* cacheModelName(sp::CacheModel model)
+    {
+        if (model == sp::FifoModel) return "fifo";
+        if (model == sp::BatchModel) return "batch";
+        return "lru";
+    }
+
+    // "1.5,0.75,2,0.5,35", in the order --tune prints them
+    bool parseParams(const char* arg, sp::VcacheParams& params)
+    {
+        return sscanf(arg, "%f,%f,%f,%f,%d", &params.cache_decay_power, &params.last_tri_score,
+                      &params.valence_boost_scale, &params.valence_boost_power, &params.max_size_cache) == 5;
+    }
+
+    int tuneMeshes(Batch& batch)
+    {
+        vector<MeshBuffer*> meshes;
+        vector<const MeshBuffer*> corpus;
+        unsigned long long triangles = 0;
+        for (size_t i=0; i<batch.files.size(); ++i) {
+            MeshBuffer* buffer = new MeshBuffer();
+            meshes.push_back(buffer);
+            if (!sp::loadMesh(*buffer, batch.files[i], batch.tune_options.threads)) {
+                fprintf(stderr, "[!] %s has no triangles, skipped\n", batch.files[i].c_str());
+                continue;
+            }
+            corpus.push_back(buffer);
+            triangles += buffer->getIdxCnt() / 3;
+        }
+
+        const sp::TuneOptions& options = batch.tune_options;
+        printf("[ ] Tuning for a %u entry %s cache over %u meshes (%llu tris) on %u threads\n",
+               options.cache_size, cacheModelName(options.model),
+               (unsigned int)corpus.size(), triangles, options.threads);
+
+        Clock::time_point start = Clock::now();
+        sp::TuneResult result = sp::tuneParams(corpus, options);
+        double total_ms = sp::elapsedMs(start);
+
+        for (size_t i=0; i<meshes.size(); ++i)
+            delete meshes[i];
+
+        if (corpus.empty()) return 1;
+        if (result.evaluations == 0) {
+            fprintf(stderr, "[!] Couldn't optimize the meshes with any starting parameters\n");
+            return 1;
+        }
+
+        const sp::VcacheParams& p = result.params;
+        if (result.default_acmr > 0.0f)
+            printf("[-] %u parameter sets in %.2f ms, ACMR %.4f -> %.4f\n", result.evaluations, total_ms,
+                   result.default_acmr, result.acmr);
+        else
+            printf("[-] %u parameter sets in %.2f ms, ACMR %.4f\n", result.evaluations, total_ms, result.acmr);
+        printf("[!] --model %s --params %g,%g,%g,%g,%d\n", cacheModelName(p.cache_model), p.cache_decay_power, p.last_tri_score,
+               p.valence_boost_scale, p.valence_boost_power, p.max_size_cache);
+        return 0;
+    }
+
+    // every worker keeps one MeshBuffer and one vcache for all its meshes
+    void worker(Batch* batch)
+    {
+        MeshBuffer buffer;
+        sp::vcache optimizer;
+        optimizer.setParams(batch->params);
+        optimizer.setThreads(batch->setup_threads);
+        sp::analyzer analyzer;
+        vector<sp::analyzer::CacheStats> before;
+        vector<unsigned int> result;
+        vector<unsigned char> encoded;
+        vector<uint16_t> local16;
+        vector<unsigned int> sub_verts;
+        vector<sp::SubMesh> subs;
+
+        while (true) {
+            size_t job = batch->next++;
+            if (job >= batch->files.size()) break;
+
+            const string& input = batch->files[job];
+            Clock::time_point start = Clock::now();
+
+            if (batch->stream) {
+                streamMesh(batch, input);
+                continue;
+            }
+
+            string cache = cachePath(input, batch->out_dir);
+            bool from_cache = false;
+            if (batch->use_cache && isNewer(cache, input)) {
+                buffer.loadFileBin(cache.c_str());
+                from_cache = buffer.getIdxCnt() > 0;
+            }
+
+            if (!from_cache)
+                sp::loadMesh(buffer, input, batch->load_threads);
+            double load_ms = sp::elapsedMs(start);
+
+            unsigned int tri_count = buffer.getIdxCnt() / 3;
+            if (tri_count == 0) {
+                lock_guard<mutex> lock(batch->print_lock);
+                fprintf(stderr, "[!] %s has no triangles, skipped\n", input.c_str());
+                continue;
+            }
+
+            if (batch->stats) {
+                analyzer.analyze(buffer.getIndexData(), buffer.getIdxCnt(), buffer.getVertCnt());
+                before.clear();
+                for (unsigned int i=0; i<analyzer.getCacheCount(); ++i) {
+                    before.push_back(analyzer.getFifo(i));
+                    before.push_back(analyzer.getLru(i));
+                    before.push_back(analyzer.getBatch(i));
+                }
+            }
+
+            Clock::time_point opt_start = Clock::now();
+            bool reused = from_cache && cachedResult(buffer, batch->result_key, result);
+            sp::ParallelResult split = { 0, 0.0f };
+            if (reused) {
+                // the cache already holds the order these options give
+            }
+            else if (batch->split) {
+                split = sp::optimizeParallel(buffer, batch->parallel, result);
+            }
+            else {
+                optimizer.optimize(buffer);
+                result.assign(optimizer.getIndices(), optimizer.getIndices() + optimizer.getIndexCount());
+            }
+            if (result.empty()) {
+                // out of memory, the optimizer logged why
+                lock_guard<mutex> lock(batch->print_lock);
+                fprintf(stderr, "[!] %s couldn't be optimized, skipped\n", input.c_str());
+                continue;
+            }
+
+            sp::OverdrawResult overdraw = { 0, 0.0f, 0.0f, 0.0f, 0.0f };
+            if (batch->overdraw && !reused)
+                overdraw = sp::optimizeOverdraw(buffer, batch->overdraw_options, &result[0], (unsigned int)result.size());
+
+            sp::FetchStats fetch = { 0.0f, 0.0f, 0 };
+            if (batch->fetch && !reused)
+                fetch = sp::optimizeVertexFetch(buffer, &result[0], (unsigned int)result.size());
+            double opt_ms = sp::elapsedMs(opt_start);
+
+            const unsigned int* indices = &result[0];
+            unsigned int index_count = (unsigned int)result.size();
+
+            string output = outputPath(input, batch->out_dir, ".vcache.obj");
+            bool written;
+            if (batch->index16) {
+                sp::splitMesh(indices, index_count, buffer.getVertCnt(), 65536, local16, sub_verts, subs);
+                written = writeSubMeshObj(output, buffer, local16, sub_verts, subs);
+            }
+            else {
+                written = writeObj(output, buffer, indices, index_count);
+            }
+
+            string compressed = outputPath(input, batch->out_dir, ".vcache.idxz");
+            bool compressed_written = true;
+            if (batch->compress) {
+                sp::encodeIndices(indices, index_count, encoded);
+                FILE* out_file = fopen(compressed.c_str(), "wb");
+                compressed_written = out_file && fwrite(&encoded[0], 1, encoded.size(), out_file) == encoded.size();
+                if (out_file && fclose(out_file) != 0) compressed_written = false;
+            }
+
+            if (batch->use_cache && !from_cache) {
+                MeshBuffer::BinSection extras[MeshBuffer::BinExtraCount] = {};
+                extras[MeshBuffer::OptimizedIndices].data = indices;
+                extras[MeshBuffer::OptimizedIndices].count = index_count;
+                // the adjacency points into the optimizer's own order, by the
+                // source vertices, so only when nothing changed either since
+                if (!batch->split && !batch->overdraw && !batch->fetch) {
+                    extras[MeshBuffer::AdjacencyOffsets].data = (const uint32_t*)optimizer.getAdjacencyOffsets();
+                    extras[MeshBuffer::AdjacencyOffsets].count = buffer.getVertCnt() + 1;
+                    extras[MeshBuffer::AdjacencyTris].data = (const uint32_t*)optimizer.getAdjacencyTris();
+                    extras[MeshBuffer::AdjacencyTris].count = buffer.getIdxCnt();
+                }
+                extras[MeshBuffer::OptimizedSettings].data = &batch->result_key[0];
+                extras[MeshBuffer::OptimizedSettings].count = (uint32_t)batch->result_key.size();
+                buffer.saveFileBin(cache.c_str(), extras);
+            }
+            double wall_ms = sp::elapsedMs(start);
+
+            if (batch->stats)
+                analyzer.analyze(indices, index_count, buffer.getVertCnt());
+
+            batch->triangles += tri_count;
+
+            lock_guard<mutex> lock(batch->print_lock);
+            if (!written)
+                fprintf(stderr, "[!] Couldn't write %s\n", output.c_str());
+            if (!compressed_written)
+                fprintf(stderr, "[!] Couldn't write %s\n", compressed.c_str());
+            printf("[-] %s: %u tris, load %.2f ms%s, optimize %.2f ms%s (%.0f tris/s), wall %.2f ms\n",
+                   input.c_str(), tri_count, load_ms, from_cache ? " (cached)" : "", opt_ms,
+                   reused ? " (cached)" : "", opt_ms > 0.0 ? tri_count / (opt_ms * 0.001) : 0.0, wall_ms);
+            if (batch->split && !reused)
+                printf("[-] %s: %u clusters, seams add ~%.4f ACMR\n", input.c_str(), split.clusters, split.seam_acmr);
+            if (batch->overdraw && !reused)
+                printf("[-] %s: %u clusters, ACMR %.4f -> %.4f, overdraw %.3f -> %.3f\n", input.c_str(),
+                       overdraw.clusters, overdraw.acmr_before, overdraw.acmr_after,
+                       overdraw.overdraw_before, overdraw.overdraw_after);
+            for (unsigned int i=0; batch->stats && i<analyzer.getCacheCount(); ++i) {
+                const sp::analyzer::CacheStats* after[3] = { &analyzer.getFifo(i), &analyzer.getLru(i), &analyzer.getBatch(i) };
+                const char* names[3] = { "FIFO ", "LRU  ", "Batch" };
+                for (int k=0; k<3; ++k)
+                    printf("[-] %s: %s %2u ACMR %.4f -> %.4f, ATVR %.3f -> %.3f\n", input.c_str(),
+                           names[k], after[k]->size, before[i * 3 + k].acmr, after[k]->acmr,
+                           before[i * 3 + k].atvr, after[k]->atvr);
+            }
+            if (batch->stats && !batch->split && !reused && sp::vcache::statsEnabled())
+                printf("[-] %s: %s\n", input.c_str(),
+                       sp::statsReport(optimizer.getStats(), optimizer.getPhaseTimes()).c_str());
+            if (batch->index16)
+                printf("[-] %s: %u sub-meshes, %u verts (%u repeated), indices %.1f KB -> %.1f KB\n",
+                       input.c_str(), (unsigned int)subs.size(), (unsigned int)sub_verts.size(),
+                       repeatedVerts(sub_verts, buffer.getVertCnt()),
+                       index_count * 4 / 1024.0, index_count * 2 / 1024.0);
+            if (batch->compress)
+                printf("[-] %s: indices compressed to %u bytes, %.2f bits per triangle\n", input.c_str(),
+                       (unsigned int)encoded.size(), encoded.size() * 8.0 / tri_count);
+            if (batch->fetch && !reused)
+                printf("[-] %s: vertex overfetch %.3f -> %.3f, %u unused verts moved to the end\n",
+                       input.c_str(), fetch.overfetch_before, fetch.overfetch_after, fetch.unused);
+        }
+    }
+
+    // two inputs that only differ in their extension, or in their directory
+    // with -o, would have their workers write the same files at once
+    bool checkOutputs(const Batch& batch)
+    {
+        vector<pair<string, size_t> > outputs;
+        for (size_t i=0; i<batch.files.size(); ++i)
+            outputs.push_back(make_pair(outputPath(batch.files[i], batch.out_dir, ".vcache.obj"), i));
+        sort(outputs.begin(), outputs.end());
+
+        bool ok = true;
+        for (size_t i=1; i<outputs.size(); ++i) {
+            if (outputs[i].first != outputs[i - 1].first) continue;
+            fprintf(stderr, "[!] %s and %s would both be written to %s\n",
+                    batch.files[outputs[i - 1].second].c_str(), batch.files[outputs[i].second].c_str(),
+                    outputs[i].first.c_str());
+            ok = false;
+        }
+        return ok;
+    }
+
+    void usage(const char* name)
+    {
+        sp::VcacheParams defaults;
+        printf("usage: %s [-j threads] [-o out_dir] [--cache] [--split [--tolerance acmr]]\n"
+               "       [--overdraw [--threshold ratio]] [--fetch] [--index16] [--compress] [--stats]\n"
+               "       [--stream [--window tris]] [--model lru|fifo|batch] [--params list]\n"
+               "       [--tune lru|fifo|batch size [--rounds n]] <mesh|dir>...\n"
+               "  optimizes every .obj/.stl given, directories are scanned for meshes.\n"
+               "  results are written next to the input as <name>.vcache.obj,\n"
+               "  or into out_dir when given.\n"
+               "  -j runs that many meshes at once (one per core by default). With\n"
+               "  fewer meshes the threads left over build the adjacency of each.\n"
+               "  --cache saves a binary <name>.<ext>.spmb beside the result and loads\n"
+               "  it on later runs instead of parsing the mesh again. The result is\n"
+               "  stored too and used as is when the options are the same.\n"
+               "  --split cuts each mesh into spatial clusters optimized on all threads,\n"
+               "  the seams may add up to --tolerance ACMR (default %.3f).\n"
+               "  --overdraw reorders the result to cut overdraw, letting the ACMR of\n"
+               "  each cluster grow by --threshold times (default %.2f).\n"
+               "  --fetch also reorders the vertices for linear vertex fetches.\n"
+               "  --index16 cuts the result into groups of at most 65536 vertices,\n"
+               "  each addressable with 16-bit indices, keeping the triangle order.\n"
+               "  --compress also writes the result as <name>.vcache.idxz, compressed\n"
+               "  with sp::encodeIndices. Pair it with --fetch for the smallest files.\n"
+               "  --stats prints the ACMR and ATVR of the input and the result for\n"
+               "  16 and 32 entry FIFO and LRU caches and batches of 16 and 32 verts,\n"
+               "  and the optimizer's counters in a build with STATS=1.\n"
+               "  --stream reads .obj files a window of --window triangles at a time\n"
+               "  (default %u) and writes the result as it goes, for meshes that don't\n"
+               "  fit in memory. The other passes are left out.\n"
+               "  --params sets the optimizer's cache decay power, last triangle score,\n"
+               "  valence boost scale, valence boost power and cache size, comma\n"
+               "  separated (default %g,%g,%g,%g,%d).\n"
+               "  --model sets the cache the optimizer models: lru (default), fifo, or\n"
+               "  batch for GPUs that share vertices only within a batch of triangles.\n"
+               "  --tune searches the --model and --params with the lowest ACMR over\n"
+               "  all the meshes for an lru, fifo or batch cache of the given size,\n"
+               "  taking at most --rounds steps (default %u). Nothing is written.\n",
+               name, sp::ParallelOptions().acmr_tolerance, sp::OverdrawOptions().threshold,
+               sp::StreamOptions().window_tris, defaults.cache_decay_power, defaults.last_tri_score,
+               defaults.valence_boost_scale, defaults.valence_boost_power, defaults.max_size_cache,
+               sp::TuneOptions().rounds);
+    }
+}
 
 int main(int argc, char** argv) {
 
-    
+    Batch batch;
+    batch.next = 0;
+    batch.triangles = 0;
+    batch.split = false;
+    batch.use_cache = false;
+    batch.overdraw = false;
+    batch.fetch = false;
+    batch.stats = false;
+    batch.stream = false;
+    batch.compress = false;
+    batch.index16 = false;
+    batch.tune = false;
+    batch.setup_threads = 1;
+    batch.load_threads = 0;
+
+    // before the inputs are collected, which logs the paths it can't open
+    sp::setLogCallback(printLog, &batch.print_lock);
+
+    unsigned int thread_count = thread::hardware_concurrency();
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            batch.out_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache") == 0) {
+            batch.use_cache = true;
+        }
+        else if (strcmp(argv[i], "--split") == 0) {
+            batch.split = true;
+        }
+        else if (strcmp(argv[i], "--overdraw") == 0) {
+            batch.overdraw = true;
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            batch.overdraw_options.threshold = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fetch") == 0) {
+            batch.fetch = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            batch.stats = true;
+        }
+        else if (strcmp(argv[i], "--index16") == 0) {
+            batch.index16 = true;
+        }
+        else if (strcmp(argv[i], "--compress") == 0) {
+            batch.compress = true;
+        }
+        else if (strcmp(argv[i], "--stream") == 0) {
+            batch.stream = true;
+        }
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            batch.stream_options.window_tris = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--params") == 0 && i + 1 < argc) {
+            if (!parseParams(argv[++i], batch.params)) {
+                fprintf(stderr, "[!] --params takes five comma separated values, got %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            if (!parseCacheModel(argv[++i], batch.params.cache_model)) {
+                fprintf(stderr, "[!] --model takes lru, fifo or batch, got %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--tune") == 0 && i + 2 < argc) {
+            batch.tune = true;
+            if (!parseCacheModel(argv[++i], batch.tune_options.model)) {
+                fprintf(stderr, "[!] --tune takes lru, fifo or batch, got %s\n", argv[i]);
+                return 1;
+            }
+            batch.tune_options.cache_size = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            batch.tune_options.rounds = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            batch.parallel.acmr_tolerance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        }
+        else {
+            sp::collectInputs(argv[i], batch.files);
+        }
+    }
+
+    if (batch.files.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (thread_count == 0) thread_count = 1;
+    unsigned int total_threads = thread_count;
+    batch.parallel.params = batch.params;
+    batch.stream_options.params = batch.params;
+
+    if (batch.tune) {
+        batch.tune_options.threads = thread_count;
+        return tuneMeshes(batch);
+    }
+
+    if (!checkOutputs(batch)) return 1;
+
+    if (batch.split && !batch.stream) {
+        batch.parallel.threads = thread_count;
+        thread_count = 1;
+    }
+    if (thread_count > batch.files.size()) {
+        batch.setup_threads = thread_count / (unsigned int)batch.files.size();
+        thread_count = (unsigned int)batch.files.size();
+    }
+    batch.load_threads = max(total_threads / thread_count, 1u);
+
+    resultKey(batch, batch.result_key);
+
+    printf("[ ] Optimizing %u meshes on %u threads\n", (unsigned int)batch.files.size(), thread_count);
+
+    Clock::time_point start = Clock::now();
+    vector<thread> workers;
+    for (unsigned int i=0; i<thread_count; ++i)
+        workers.push_back(thread(worker, &batch));
+    for (size_t i=0; i<workers.size(); ++i)
+        workers[i].join();
+    double total_ms = sp::elapsedMs(start);
+
+    unsigned long long triangles = batch.triangles;
+    printf("[!] %llu tris in %.2f ms, %.0f tris/s\n", triangles, total_ms,
+           total_ms > 0.0 ? triangles / (total_ms * 0.001) : 0.0);
 
     return 0;
 }
-
@@ -0,0 +1,61 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile()
+    : Data(0)
+    , Size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char * fileName)
+{
+    close();
+
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    // the loaders walk the file front to back
+    madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+
+    Data = (const char*)mapping;
+    Size = info.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (Data)
+        munmap((void*)Data, Size);
+    Data = 0;
+    Size = 0;
+}
+
+const char* MappedFile::data() const
+{
+    return Data;
+}
+
+size_t MappedFile::size() const
+{
+    return Size;
+}
@@ -0,0 +1,29 @@
+// Read only memory mapping of a whole file
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // returns false and leaves the object empty when the file can't be mapped
+    bool open(const char * fileName);
+    void close();
+
+    const char* data() const;
+    size_t size() const;
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile& operator=(const MappedFile &);
+
+    const char* Data;
+    size_t Size;
+};
+
+#endif // MAPPED_FILE_H
@@ -1,8 +1,410 @@
 #include "meshbuffer.h"
 #include <assert.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include <iostream>
-#include "vertexattributeindices.h"
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include "log.h"
+#include "mappedfile.h"
+
+namespace
+{
+    const uint32_t EmptySlot = 0xffffffffu;
+
+    // Open addressing table from three 32 bit words to an index.
+    // The key is kept in the slot so a probe touches a single cache line.
+    class TripleTable
+    {
+    public:
+        explicit TripleTable(size_t expected)
+            : Count(0)
+        {
+            size_t size = 64;
+            while (size < expected) size <<= 1;
+            Slots.resize(size);
+            for (size_t i=0; i<size; ++i) Slots[i].index = EmptySlot;
+        }
+
+        // returns the index already stored for key, or stores and returns index
+        uint32_t insert(const uint32_t* key, uint32_t index)
+        {
+            size_t mask = Slots.size() - 1;
+            size_t slot = hash(key) & mask;
+            while (Slots[slot].index != EmptySlot)
+            {
+                const Slot& other = Slots[slot];
+                if (other.key[0] == key[0] && other.key[1] == key[1] && other.key[2] == key[2])
+                    return other.index;
+                slot = (slot + 1) & mask;
+            }
+
+            Slot& added = Slots[slot];
+            memcpy(added.key, key, sizeof(added.key));
+            added.index = index;
+
+            // keep the table at most half full
+            if (++Count * 2 > Slots.size())
+                grow();
+            return index;
+        }
+
+    private:
+        struct Slot
+        {
+            uint32_t key[3];
+            uint32_t index;
+        };
+
+        static size_t hash(const uint32_t* key)
+        {
+            uint64_t h = key[0] * 0x9e3779b97f4a7c15ull;
+            h ^= key[1] * 0xc2b2ae3d27d4eb4full + (h >> 29);
+            h ^= key[2] * 0x165667b19e3779f9ull + (h >> 32);
+            return (size_t)(h ^ (h >> 31));
+        }
+
+        void grow()
+        {
+            std::vector<Slot> old(Slots.size() * 2);
+            old.swap(Slots);
+            for (size_t i=0; i<Slots.size(); ++i) Slots[i].index = EmptySlot;
+
+            size_t mask = Slots.size() - 1;
+            for (size_t i=0; i<old.size(); ++i)
+            {
+                if (old[i].index == EmptySlot) continue;
+                size_t slot = hash(old[i].key) & mask;
+                while (Slots[slot].index != EmptySlot) slot = (slot + 1) & mask;
+                Slots[slot] = old[i];
+            }
+        }
+
+        size_t Count;
+        std::vector<Slot> Slots;
+    };
+
+    // -0.0 and 0.0 weld together, everything else has to match exactly
+    void positionKey(const float* pos, uint32_t* key)
+    {
+        for (int k=0; k<3; ++k)
+        {
+            float value = pos[k] == 0.0f ? 0.0f : pos[k];
+            memcpy(&key[k], &value, sizeof(float));
+        }
+    }
+
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p < end && isBlank(*p)) ++p;
+        return p;
+    }
+
+    // Plain decimal float reader, no locale and no iostream. The digits are
+    // gathered into a 64 bit mantissa and scaled by an exact power of ten,
+    // which is within an ulp of strtof for anything a mesh exporter writes.
+    // returns 0 when there is no number at p.
+    const char* parseFloat(const char* p, const char* end, float& out)
+    {
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        p = skipBlanks(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        const char* start = p;
+        for (; p < end && (unsigned)(*p - '0') < 10; ++p)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+            }
+            else
+                exponent++;
+        }
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && (unsigned)(*p - '0') < 10; ++p)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa) digits++;
+                    exponent--;
+                }
+            }
+        }
+        if (p == start || (p == start + 1 && *start == '.')) return 0;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* q = p + 1;
+            bool exp_negative = false;
+            if (q < end && (*q == '-' || *q == '+'))
+            {
+                exp_negative = *q == '-';
+                ++q;
+            }
+            if (q < end && (unsigned)(*q - '0') < 10)
+            {
+                int value = 0;
+                for (; q < end && (unsigned)(*q - '0') < 10; ++q)
+                    if (value < 10000) value = value * 10 + (*q - '0');
+                exponent += exp_negative ? -value : value;
+                p = q;
+            }
+        }
+
+        double value = (double)mantissa;
+        if (exponent < 0 && exponent >= -22)
+            value /= powers[-exponent];
+        else if (exponent > 0 && exponent <= 22)
+            value *= powers[exponent];
+        else if (exponent != 0)
+            value *= pow(10.0, exponent);
+
+        out = (float)(negative ? -value : value);
+        return p;
+    }
+
+    const char* parseInt(const char* p, const char* end, int& out)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+        if (p >= end || (unsigned)(*p - '0') >= 10) return 0;
+
+        int value = 0;
+        for (; p < end && (unsigned)(*p - '0') < 10; ++p)
+            value = value * 10 + (*p - '0');
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // one face corner as written in the file. index 0 is the position,
+    // 1 the texcoord, 2 the normal. Missing ones are NoAttribute. Negative
+    // (relative) indices can point into earlier chunks, so they are kept
+    // relative to the chunk and marked in the relative bits.
+    struct ObjCorner
+    {
+        int32_t index[3];
+        uint32_t relative;
+    };
+
+    const int32_t NoAttribute = INT32_MIN;
+
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        std::vector<ObjCorner> corners; // three per triangle
+
+        size_t line_error; // 0 or the offset of the first bad line
+    };
+
+    // reads "p", "p/t", "p//n" or "p/t/n"
+    const char* parseCorner(const char* p, const char* end, const ObjChunk& chunk, ObjCorner& corner)
+    {
+        const size_t counts[3] = { chunk.positions.size(), chunk.texcoords.size(), chunk.normals.size() };
+
+        corner.relative = 0;
+        corner.index[0] = corner.index[1] = corner.index[2] = NoAttribute;
+        for (int k=0; k<3; ++k)
+        {
+            if (k > 0)
+            {
+                if (p >= end || *p != '/') break;
+                ++p;
+                if (p < end && *p == '/') continue;
+            }
+
+            int value = 0;
+            p = parseInt(p, end, value);
+            if (!p || value == 0) return 0;
+
+            if (value > 0)
+            {
+                // faces start at 1, not 0
+                corner.index[k] = value - 1;
+            }
+            else
+            {
+                corner.index[k] = (int32_t)counts[k] + value;
+                corner.relative |= 1u << k;
+            }
+        }
+        return p;
+    }
+
+    void parseChunk(ObjChunk* chunk)
+    {
+        std::vector<ObjCorner> polygon;
+
+        chunk->line_error = 0;
+        const char* p = chunk->begin;
+        const char* end = chunk->end;
+        while (p < end)
+        {
+            const char* line_end = (const char*)memchr(p, '\n', end - p);
+            if (!line_end) line_end = end;
+
+            const char* q = skipBlanks(p, line_end);
+            bool ok = true;
+            if (line_end - q >= 2 && q[0] == 'v' && isBlank(q[1]))
+            {
+                glm::vec3 pos;
+                q += 1;
+                for (int k=0; k<3 && q; ++k) q = parseFloat(q, line_end, pos[k]);
+                ok = q != 0;
+                chunk->positions.push_back(pos);
+            }
+            else if (line_end - q >= 3 && q[0] == 'v' && q[1] == 't' && isBlank(q[2]))
+            {
+                glm::vec2 coord;
+                q += 2;
+                for (int k=0; k<2 && q; ++k) q = parseFloat(q, line_end, coord[k]);
+                ok = q != 0;
+                chunk->texcoords.push_back(coord);
+            }
+            else if (line_end - q >= 3 && q[0] == 'v' && q[1] == 'n' && isBlank(q[2]))
+            {
+                glm::vec3 norm;
+                q += 2;
+                for (int k=0; k<3 && q; ++k) q = parseFloat(q, line_end, norm[k]);
+                ok = q != 0;
+                chunk->normals.push_back(norm);
+            }
+            else if (line_end - q >= 2 && q[0] == 'f' && isBlank(q[1]))
+            {
+                polygon.clear();
+                for (q = skipBlanks(q + 1, line_end); q < line_end; q = skipBlanks(q, line_end))
+                {
+                    ObjCorner corner;
+                    q = parseCorner(q, line_end, *chunk, corner);
+                    if (!q) break;
+                    polygon.push_back(corner);
+                }
+                ok = q != 0 && polygon.size() >= 3;
+
+                // polygons are split into a fan around their first corner
+                for (size_t i=2; ok && i<polygon.size(); ++i)
+                {
+                    chunk->corners.push_back(polygon[0]);
+                    chunk->corners.push_back(polygon[i - 1]);
+                    chunk->corners.push_back(polygon[i]);
+                }
+            }
+            // everything else (comments, groups, materials, lines) is skipped
+
+            if (!ok && !chunk->line_error)
+                chunk->line_error = (size_t)(p - chunk->begin) + 1;
+            p = line_end + 1;
+        }
+    }
+
+    // values[i] ends up at values[remap[i]]
+    template <typename T>
+    void permuteInPlace(std::vector<T>& values, const uint32_t* remap, std::vector<bool>& visited)
+    {
+        visited.assign(values.size(), false);
+        for (size_t i=0; i<values.size(); ++i)
+        {
+            if (visited[i]) continue;
+
+            T carried = values[i];
+            size_t at = i;
+            do
+            {
+                at = remap[at];
+                std::swap(carried, values[at]);
+                visited[at] = true;
+            } while (at != i);
+        }
+    }
+
+    // binary cache, see MeshBuffer::loadFileBin
+    const char BinMagic[4] = { 'S', 'P', 'M', 'B' };
+    // 2: the adjacency holds places in the optimized order, not source triangles
+    const uint32_t BinVersion = 2;
+    const size_t BinAlign = 64;
+
+    enum BinSectionType
+    {
+        BinPositions = 1,
+        BinNormals = 2,
+        BinTexCoords = 3,
+        BinIndices = 4,
+        BinGeneric0 = 8,    // through BinGeneric0 + 4
+        BinOptimized = 16,  // then the rest of MeshBuffer::BinExtra in order
+        BinAdjOffsets = 17,
+        BinAdjTris = 18,
+        BinOptimizedSettings = 19
+    };
+
+    struct BinHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t vert_cnt;
+        uint32_t idx_cnt;
+        uint32_t section_count;
+        uint32_t reserved[3];
+    };
+
+    struct BinEntry
+    {
+        uint32_t type;
+        uint32_t count;     // elements, not bytes
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    // 0 for sections this version doesn't know about
+    size_t binElementSize(uint32_t type)
+    {
+        switch (type)
+        {
+        case BinPositions:
+        case BinNormals:
+            return sizeof(glm::vec3);
+        case BinTexCoords:
+            return sizeof(glm::vec2);
+        case BinIndices:
+        case BinOptimized:
+        case BinAdjOffsets:
+        case BinAdjTris:
+        case BinOptimizedSettings:
+            return sizeof(uint32_t);
+        }
+        if (type >= BinGeneric0 && type < BinGeneric0 + 5)
+            return sizeof(glm::vec4);
+        return 0;
+    }
+}
 
 MeshBuffer::MeshBuffer()
     : UsesNormals(false)
@@ -12,8 +414,9 @@ MeshBuffer::MeshBuffer()
     , VertCnt(0)
     , IdxCnt(0)
     , Generics(5)
+    , Mapping(0)
 {
-
+    memset(&Mapped, 0, sizeof(Mapped));
 }
 
 MeshBuffer::~MeshBuffer()
@@ -25,9 +428,13 @@ MeshBuffer::MeshBuffer(const MeshBuffer & ref)
     : UsesNormals(false)
     , UsesUVs(false)
     , UsesIndices(false)
+    , UsesGenerics(5, false)
     , VertCnt(0)
     , IdxCnt(0)
+    , Generics(5)
+    , Mapping(0)
 {
+    memset(&Mapped, 0, sizeof(Mapped));
     this->operator =(ref);
 }
 
@@ -36,34 +443,23 @@ MeshBuffer& MeshBuffer::operator=(const MeshBuffer & ref)
     if (this == &ref) return *this;
     cleanUp();
 
-    setVerts(ref.VertCnt, (float*)&ref.Verts[0]);
-    setNorms(ref.VertCnt, (float*)&ref.Norms[0]);
-    setTexCoords(0, ref.VertCnt, (float*)&ref.TexCoords[0]);
+    // goes through the data accessors so a mapped buffer copies out too
+    setVerts(ref.VertCnt, (const float*)ref.getVertData());
+    if (ref.UsesNormals)
+        setNorms(ref.VertCnt, (const float*)ref.getNormData());
+    if (ref.UsesUVs)
+        setTexCoords(0, ref.VertCnt, (const float*)ref.getTexCoordData());
 
     for (size_t i=0; i<5; ++i)
         if (ref.UsesGenerics[i])
-            setGenerics(i, ref.getGenerics(i));
+            setGenerics(i, std::vector<glm::vec4>(ref.getGenericData(i), ref.getGenericData(i) + ref.VertCnt));
 
-    setIndices(ref.IdxCnt, (uint32_t*)&ref.Indices[0]);
+    setIndices(ref.IdxCnt, ref.getIndexData());
     return *this;
 }
 
-void MeshBuffer::loadFileObj(const char * fileName)
+void MeshBuffer::loadFileObj(const char * fileName, unsigned int threads)
 {
-  // get the mesh
-    #ifdef HIDEME
-    AttributeContainer<Attributes::Position> constPosition = mesh->GetAttributes<Attributes::Position>( size_t(0u) );
-    AttributeContainer<Attributes::Position>::const_iterator pos_itr = constPosition.begin();
-
-    AttributeContainer<Attributes::Normal> constNormal = mesh->GetAttributes<Attributes::Normal>( size_t(0u) );
-    AttributeContainer<Attributes::Normal>::const_iterator norm_itr = constNormal.begin();
-
-    AttributeContainer<Attributes::TexCoord> constTexCoord = mesh->GetAttributes<Attributes::TexCoord>( size_t(0u) );
-    AttributeContainer<Attributes::TexCoord>::const_iterator tex_itr = constTexCoord.begin();
-
-    FaceContainer faces = mesh->GetFaces();
-    FaceContainer::const_iterator face_itr = faces.begin();
-
     /* The Obj file format description
     # comments
 
@@ -87,88 +483,146 @@ void MeshBuffer::loadFileObj(const char * fileName)
     # faces with positions, norms and textures
     f 1/1/1 2/2/2 3/3/3
     */
+    cleanUp();
 
-    std::ofstream out_file(filename.c_str());
-
-    out_file << "# Medical Simulation Corparation" << std::endl;
-    // send in the positions
-    for (; pos_itr != constPosition.end(); ++pos_itr)
-    {                
-        out_file << "v " << (*pos_itr)[0] << " " << (*pos_itr)[1] << " " << (*pos_itr)[2] << "\n";
-    }
-    out_file << std::endl;
-
-    
-    // send in the texCoords
-    for (; tex_itr != constTexCoord.end(); ++tex_itr)
-    {                
-        out_file << "vt " << tex_itr->u << " " << tex_itr->v << "\n";
+    MappedFile in_file;
+    if (!in_file.open(fileName)) {
+        sp::logMessage(sp::LogError, "Can't open %s", fileName);
+        return;
     }
-    out_file << std::endl;
 
-    // and now the normals
-    for (; norm_itr != constNormal.end(); ++norm_itr)
-    {                
-        out_file << "vn " << (*norm_itr)[0] << " " << (*norm_itr)[1] << " " << (*norm_itr)[2] << "\n";
-    }
-    out_file << std::endl;
+    // cut the file into line aligned chunks of at least 1 MB, one per thread
+    const char* data = in_file.data();
+    const char* end = data + in_file.size();
+    size_t chunk_count = in_file.size() / (1 << 20) + 1;
+    size_t thread_count = threads ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+    chunk_count = std::min(chunk_count, thread_count);
 
-    // set up the faces
-    // Our meshes are kept interleaved, so the relationship between vert attributes are on a 1 to 1 basis
-    if (!constNormal.empty() && !constTexCoord.empty())
+    std::vector<ObjChunk> chunks(chunk_count);
+    const char* cut = data;
+    for (size_t c=0; c<chunk_count; ++c)
     {
-        for (; face_itr != faces.end(); ++face_itr)
+        chunks[c].begin = cut;
+        if (c + 1 == chunk_count)
+            cut = end;
+        else
         {
-            unsigned short a = (*face_itr)[0]+1;
-            unsigned short b = (*face_itr)[1]+1;
-            unsigned short c = (*face_itr)[2]+1;
-            out_file << "f " << a << "/" << a << "/" << a << " " 
-                             << b << "/" << b << "/" << b << " " 
-                             << c << "/" << c << "/" << c << "\n";
+            cut = std::max(cut, data + in_file.size() / chunk_count * (c + 1));
+            const char* line_end = (const char*)memchr(cut, '\n', end - cut);
+            cut = line_end ? line_end + 1 : end;
         }
+        chunks[c].end = cut;
     }
-    else if (!constTexCoord.empty())
+
+    std::vector<std::thread> workers;
+    for (size_t c=1; c<chunk_count; ++c)
+        workers.push_back(std::thread(parseChunk, &chunks[c]));
+    parseChunk(&chunks[0]);
+    for (size_t i=0; i<workers.size(); ++i)
+        workers[i].join();
+
+    // relative indices are resolved against the attributes before each chunk
+    std::vector<size_t> bases(chunk_count * 3);
+    size_t totals[3] = { 0, 0, 0 };
+    size_t corner_count = 0;
+    for (size_t c=0; c<chunk_count; ++c)
     {
-        for (; face_itr != faces.end(); ++face_itr)
-        {
-            unsigned short a = (*face_itr)[0]+1;
-            unsigned short b = (*face_itr)[1]+1;
-            unsigned short c = (*face_itr)[2]+1;
-            out_file << "f " << a << "/" << a << " "
-                             << b << "/" << b << " "
-                             << c << "/" << c << "\n";
-        }
+        if (chunks[c].line_error)
+            sp::logMessage(sp::LogWarning, "%s: skipped a bad line at byte %llu", fileName,
+                           (unsigned long long)((chunks[c].begin - data) + chunks[c].line_error - 1));
+
+        bases[c * 3 + 0] = totals[0];
+        bases[c * 3 + 1] = totals[1];
+        bases[c * 3 + 2] = totals[2];
+        totals[0] += chunks[c].positions.size();
+        totals[1] += chunks[c].texcoords.size();
+        totals[2] += chunks[c].normals.size();
+        corner_count += chunks[c].corners.size();
     }
-    else if (!constNormal.empty())
+
+    bool has_attribute[3] = { true, false, false };
+    Indices.resize(corner_count);
+    std::vector<uint32_t> attributes(corner_count * 3);
+    size_t corner = 0;
+    for (size_t c=0; c<chunk_count; ++c)
     {
-        for (; face_itr != faces.end(); ++face_itr)
+        const std::vector<ObjCorner>& corners = chunks[c].corners;
+        for (size_t i=0; i<corners.size(); ++i, ++corner)
         {
-            unsigned short a = (*face_itr)[0]+1;
-            unsigned short b = (*face_itr)[1]+1;
-            unsigned short c = (*face_itr)[2]+1;
-            out_file << "f " << a << "//" << a << " "
-                             << b << "//" << b << " "
-                             << c << "//" << c << "\n";
+            for (int k=0; k<3; ++k)
+            {
+                int64_t index = corners[i].index[k];
+                if (index == NoAttribute)
+                {
+                    attributes[corner * 3 + k] = EmptySlot;
+                    continue;
+                }
+                if (corners[i].relative & (1u << k))
+                    index += bases[c * 3 + k];
+                if (index < 0 || index >= (int64_t)totals[k])
+                {
+                    sp::logMessage(sp::LogError, "%s: face index out of range", fileName);
+                    cleanUp();
+                    return;
+                }
+                attributes[corner * 3 + k] = (uint32_t)index;
+                has_attribute[k] = true;
+            }
         }
     }
+
+    Verts.reserve(totals[0]);
+    for (size_t c=0; c<chunk_count; ++c)
+        Verts.insert(Verts.end(), chunks[c].positions.begin(), chunks[c].positions.end());
+
+    if (!has_attribute[1] && !has_attribute[2])
+    {
+        // positions only, the file's numbering is already the index space
+        for (size_t i=0; i<corner_count; ++i)
+            Indices[i] = attributes[i * 3];
+    }
     else
     {
-        for (; face_itr != faces.end(); ++face_itr)
-        {                                
-            out_file << "f " << (*face_itr)[0] << " " << (*face_itr)[1] << " " << (*face_itr)[2] << "\n";
+        // every distinct position/texcoord/normal tuple becomes a vertex
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        positions.swap(Verts);
+        texcoords.reserve(totals[1]);
+        normals.reserve(totals[2]);
+        for (size_t c=0; c<chunk_count; ++c)
+        {
+            texcoords.insert(texcoords.end(), chunks[c].texcoords.begin(), chunks[c].texcoords.end());
+            normals.insert(normals.end(), chunks[c].normals.begin(), chunks[c].normals.end());
+        }
+
+        UsesUVs = has_attribute[1];
+        UsesNormals = has_attribute[2];
+        TripleTable tuples(positions.size());
+        for (size_t i=0; i<corner_count; ++i)
+        {
+            const uint32_t* key = &attributes[i * 3];
+            uint32_t index = tuples.insert(key, (uint32_t)Verts.size());
+            if (index == Verts.size())
+            {
+                Verts.push_back(positions[key[0]]);
+                if (UsesUVs)
+                    TexCoords.push_back(key[1] != EmptySlot ? texcoords[key[1]] : glm::vec2(0.0f, 0.0f));
+                if (UsesNormals)
+                    Norms.push_back(key[2] != EmptySlot ? normals[key[2]] : glm::vec3(0.0f));
+            }
+            Indices[i] = index;
         }
     }
 
-    out_file << std::endl;
-    out_file.close();
-    #endif
+    VertCnt = (unsigned int)Verts.size();
+    IdxCnt = (unsigned int)Indices.size();
+    UsesIndices = true;
 }
 
 void MeshBuffer::loadFileStl(const char * fileName)
 {
-    std::ifstream in_file(filename, std::ifstream::binary);
-
-    /*  
+    /*
         The Stl file format description
         From: https://en.wikipedia.org/wiki/STL_(file_format)
         UINT8[80] – Header, ignored by most applications
@@ -182,47 +636,266 @@ void MeshBuffer::loadFileStl(const char * fileName)
         UINT16 – Attribute byte count, almost no applications use this and should be 0
         end
     */
+    cleanUp();
 
+    MappedFile in_file;
+    if (!in_file.open(fileName)) {
+        sp::logMessage(sp::LogError, "Can't open %s", fileName);
+        return;
+    }
 
-    /*
-        unsigned int VertCnt;
-        unsigned int IdxCnt;
+    const size_t header_size = 84;
+    const size_t record_size = 50;
+    if (in_file.size() < header_size) {
+        sp::logMessage(sp::LogError, "%s is too small to be a binary stl", fileName);
+        return;
+    }
 
-        std::vector<glm::vec3> Verts;
-        std::vector<glm::vec3> Norms;
-        std::vector<glm::vec2> TexCoords;
+    uint32_t num_triangles = 0;
+    memcpy(&num_triangles, in_file.data() + 80, sizeof(uint32_t));
+    if (in_file.size() < header_size + record_size * (size_t)num_triangles) {
+        // ascii files start with "solid" and their triangle count is garbage
+        sp::logMessage(sp::LogError, "%s is not a binary stl, or it is truncated", fileName);
+        return;
+    }
+
+    // the facet normals are not used, the vertex normals
+    // are rebuilt from the welded positions below
+    // closed meshes have about half as many verts as triangles
+    TripleTable welder(num_triangles);
+    Verts.reserve(num_triangles / 2 + 3);
+    Indices.resize(num_triangles * 3);
+
+    const char* record = in_file.data() + header_size;
+    for (uint32_t i = 0; i < num_triangles; ++i, record += record_size)
+    {
+        // records are only 2 byte aligned
+        float corners[9];
+        memcpy(corners, record + 3 * sizeof(float), sizeof(corners));
+
+        for (int k=0; k<3; ++k)
+        {
+            uint32_t key[3];
+            positionKey(&corners[k * 3], key);
 
-        std::vector<uint32_t>  Indices;
+            uint32_t index = welder.insert(key, (uint32_t)Verts.size());
+            if (index == Verts.size())
+                Verts.push_back(glm::vec3(corners[k * 3 + 0], corners[k * 3 + 1], corners[k * 3 + 2]));
+            Indices[i * 3 + k] = index;
+        }
+    }
+
+    VertCnt = (unsigned int)Verts.size();
+    IdxCnt = num_triangles * 3;
+    UsesIndices = true;
+
+    // area weighted vertex normals, the welding made these shared
+    UsesNormals = true;
+    Norms.assign(VertCnt, glm::vec3(0.0f));
+    for (unsigned int i=0; i<IdxCnt; i+=3)
+    {
+        const glm::vec3& vec_a = Verts[Indices[i + 0]];
+        const glm::vec3& vec_b = Verts[Indices[i + 1]];
+        const glm::vec3& vec_c = Verts[Indices[i + 2]];
+        glm::vec3 norm = glm::cross(vec_b - vec_a, vec_c - vec_a);
+        for (int k=0; k<3; ++k)
+            Norms[Indices[i + k]] += norm;
+    }
+    for (unsigned int i=0; i<VertCnt; ++i)
+    {
+        float len = glm::length(Norms[i]);
+        if (len > 0.0f) Norms[i] /= len;
+    }
+}
+
+void MeshBuffer::loadFileBin(const char * fileName)
+{
+    /*
+        Binary cache layout, little endian
+        BinHeader                       32 bytes
+        BinEntry[section_count]         24 bytes each
+        sections, each starting on a 64 byte boundary so they can be
+        used straight out of the mapping
     */
+    cleanUp();
 
-    uint8_t header[80] = { 0 };
-    uint32_t num_triangles = 0;
-    in_file.read((const char*)&header[0], 80);
-    in_file.read((const char*)&num_triangles, sizeof(uint32_t));
+    MappedFile* in_file = new MappedFile;
+    if (!in_file->open(fileName)) {
+        sp::logMessage(sp::LogError, "Can't open %s", fileName);
+        delete in_file;
+        return;
+    }
+
+    const char* data = in_file->data();
+    size_t size = in_file->size();
+    const char* error = 0;
+
+    BinHeader header;
+    if (size < sizeof(BinHeader))
+        error = "too small";
+    else
+    {
+        memcpy(&header, data, sizeof(BinHeader));
+        if (memcmp(header.magic, BinMagic, 4) != 0)
+            error = "not a mesh cache";
+        else if (header.version != BinVersion)
+            error = "written by a different version";
+        else if (size < sizeof(BinHeader) + header.section_count * sizeof(BinEntry))
+            error = "truncated section table";
+    }
+
+    for (uint32_t i=0; !error && i<header.section_count; ++i)
+    {
+        BinEntry entry;
+        memcpy(&entry, data + sizeof(BinHeader) + i * sizeof(BinEntry), sizeof(BinEntry));
+
+        size_t element = binElementSize(entry.type);
+        if (!element)
+            continue; // newer optional section, skip it
+        if (entry.offset % BinAlign || entry.offset > size || entry.bytes > size - entry.offset
+            || entry.bytes != (uint64_t)entry.count * element)
+        {
+            error = "bad section bounds";
+            break;
+        }
+
+        const char* section = data + entry.offset;
+        bool per_vert = entry.type != BinIndices && entry.type < BinOptimized;
+        if ((per_vert && entry.count != header.vert_cnt)
+            || (entry.type == BinIndices && entry.count != header.idx_cnt))
+        {
+            error = "section size does not match the mesh";
+            break;
+        }
+
+        if (entry.type == BinPositions)
+            Mapped.verts = (const glm::vec3*)section;
+        else if (entry.type == BinNormals)
+            Mapped.norms = (const glm::vec3*)section;
+        else if (entry.type == BinTexCoords)
+            Mapped.texCoords = (const glm::vec2*)section;
+        else if (entry.type == BinIndices)
+            Mapped.indices = (const uint32_t*)section;
+        else if (entry.type >= BinGeneric0 && entry.type < BinGeneric0 + 5)
+            Mapped.generics[entry.type - BinGeneric0] = (const glm::vec4*)section;
+        else
+        {
+            BinSection& extra = Mapped.extras[entry.type - BinOptimized];
+            extra.data = (const uint32_t*)section;
+            extra.count = entry.count;
+        }
+    }
+
+    if (!error && ((header.vert_cnt && !Mapped.verts) || (header.idx_cnt && !Mapped.indices)))
+        error = "missing positions or indices";
+
+    if (error)
+    {
+        sp::logMessage(sp::LogError, "%s: %s", fileName, error);
+        memset(&Mapped, 0, sizeof(Mapped));
+        delete in_file;
+        return;
+    }
+
+    Mapping = in_file;
+    VertCnt = header.vert_cnt;
+    IdxCnt = header.idx_cnt;
+    UsesNormals = Mapped.norms != 0;
+    UsesUVs = Mapped.texCoords != 0;
+    UsesIndices = Mapped.indices != 0;
+    for (unsigned int i=0; i<UsesGenerics.size(); ++i)
+        UsesGenerics[i] = Mapped.generics[i] != 0;
+}
+
+void MeshBuffer::saveFileBin(const char * fileName, const BinSection* extras) const
+{
+    std::vector<BinEntry> entries;
+    std::vector<const void*> sources;
+
+    struct
+    {
+        uint32_t type;
+        bool used;
+        uint32_t count;
+        const void* data;
+    } sections[] = {
+        { BinPositions, VertCnt > 0, VertCnt, getVertData() },
+        { BinNormals, UsesNormals, VertCnt, getNormData() },
+        { BinTexCoords, UsesUVs, VertCnt, getTexCoordData() },
+        { BinIndices, IdxCnt > 0, IdxCnt, getIndexData() },
+        { BinGeneric0 + 0, UsesGenerics[0], VertCnt, getGenericData(0) },
+        { BinGeneric0 + 1, UsesGenerics[1], VertCnt, getGenericData(1) },
+        { BinGeneric0 + 2, UsesGenerics[2], VertCnt, getGenericData(2) },
+        { BinGeneric0 + 3, UsesGenerics[3], VertCnt, getGenericData(3) },
+        { BinGeneric0 + 4, UsesGenerics[4], VertCnt, getGenericData(4) },
+        { BinOptimized, extras && extras[OptimizedIndices].count, extras ? extras[OptimizedIndices].count : 0, extras ? extras[OptimizedIndices].data : 0 },
+        { BinAdjOffsets, extras && extras[AdjacencyOffsets].count, extras ? extras[AdjacencyOffsets].count : 0, extras ? extras[AdjacencyOffsets].data : 0 },
+        { BinAdjTris, extras && extras[AdjacencyTris].count, extras ? extras[AdjacencyTris].count : 0, extras ? extras[AdjacencyTris].data : 0 },
+        { BinOptimizedSettings, extras && extras[OptimizedSettings].count, extras ? extras[OptimizedSettings].count : 0, extras ? extras[OptimizedSettings].data : 0 },
+    };
+
+    uint64_t offset = sizeof(BinHeader) + sizeof(BinEntry) * (sizeof(sections) / sizeof(sections[0]));
+    for (size_t i=0; i<sizeof(sections) / sizeof(sections[0]); ++i)
+    {
+        if (!sections[i].used || !sections[i].data) continue;
+
+        BinEntry entry;
+        offset = (offset + BinAlign - 1) / BinAlign * BinAlign;
+        entry.type = sections[i].type;
+        entry.count = sections[i].count;
+        entry.offset = offset;
+        entry.bytes = (uint64_t)entry.count * binElementSize(entry.type);
+        offset += entry.bytes;
+
+        entries.push_back(entry);
+        sources.push_back(sections[i].data);
+    }
 
-    VertCnt = num_triangles / 3;
-    IdxCnt = ;
-    
-    for (uint32_t i = 0; i < num_triangles; ++i)
+    BinHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BinMagic, 4);
+    header.version = BinVersion;
+    header.vert_cnt = VertCnt;
+    header.idx_cnt = IdxCnt;
+    header.section_count = (uint32_t)entries.size();
+
+    FILE* out_file = fopen(fileName, "wb");
+    if (!out_file)
     {
-        glm::vec3 verta, vertb, vertc;
-        glm::vec3 normal;
-        in_file.write((const char*)&normal, sizeof(glm::vec3));
-        in_file.write((const char*)&verta, sizeof(glm::vec3));
-        in_file.write((const char*)&vertb, sizeof(glm::vec3));
-        in_file.write((const char*)&vertc, sizeof(glm::vec3));
+        sp::logMessage(sp::LogError, "Can't write %s", fileName);
+        return;
+    }
 
-        // move to the next bytes.
-        uint16_t null;
-        in_file.write((const char*)&null, sizeof(uint16_t));
+    static const char padding[BinAlign] = { 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, out_file) == 1;
+    if (!entries.empty())
+        ok = ok && fwrite(&entries[0], sizeof(BinEntry), entries.size(), out_file) == entries.size();
 
+    uint64_t written = sizeof(BinHeader) + sizeof(BinEntry) * entries.size();
+    for (size_t i=0; ok && i<entries.size(); ++i)
+    {
+        size_t pad = (size_t)(entries[i].offset - written);
+        ok = fwrite(padding, 1, pad, out_file) == pad;
+        ok = ok && fwrite(sources[i], 1, (size_t)entries[i].bytes, out_file) == entries[i].bytes;
+        written = entries[i].offset + entries[i].bytes;
     }
-    in_file.close();
+
+    if (fclose(out_file) != 0 || !ok)
+        sp::logMessage(sp::LogError, "Failed writing %s", fileName);
+}
+
+MeshBuffer::BinSection MeshBuffer::getBinExtra(BinExtra extra) const
+{
+    if (Mapping) return Mapped.extras[extra];
+
+    BinSection none = { 0, 0 };
+    return none;
 }
 
 void MeshBuffer::setVerts(unsigned int count, const float* verts)
 {
     if (!verts) return;
+    detach();
 
     VertCnt = count;
     Verts.resize(VertCnt);
@@ -242,11 +915,12 @@ void MeshBuffer::setNorms(unsigned int count, const float* normals)
 {
     if (count != VertCnt)
     {
-        std::cout << "Vert count does not match the number normals to create" << std::endl;
+        sp::logMessage(sp::LogError, "Vert count does not match the number normals to create");
         exit(1);
     }
 
     if (!normals) return;
+    detach();
     UsesNormals = true;
 
     Norms.clear();
@@ -268,11 +942,12 @@ void MeshBuffer::setTexCoords(unsigned int layer, unsigned int count, const floa
 {
     if (count != VertCnt)
     {
-        std::cout << "Vert count does not match the number uvs to create" << std::endl;
+        sp::logMessage(sp::LogError, "Vert count does not match the number uvs to create");
         exit(1);
     }
 
     if (!coords) return;
+    detach();
     UsesUVs = true;
 
     TexCoords.clear();
@@ -293,15 +968,16 @@ void MeshBuffer::setGenerics(unsigned int index, const std::vector<glm::vec4>& v
 {
     if (values.size() != VertCnt)
     {
-        std::cout << "Vert count does not match the number generic values to add to vbo" << std::endl;
+        sp::logMessage(sp::LogError, "Vert count does not match the number generic values to add to vbo");
         exit(1);
     }
 
     if (index >= (unsigned int)UsesGenerics.size())
     {
-        std::cout << "setGenerics index is not within the valid range of [0-4]" << std::endl;
+        sp::logMessage(sp::LogError, "setGenerics index is not within the valid range of [0-4]");
         exit(1);
     }
+    detach();
     UsesGenerics[index] = true;
 
     Generics[index].clear();
@@ -312,15 +988,11 @@ void MeshBuffer::setGenerics(unsigned int index, const std::vector<glm::vec4>& v
 void MeshBuffer::setIndices(unsigned int count, const unsigned int * indices)
 {
     if (!indices) return;
+    detach();
     UsesIndices = true;
 
     IdxCnt = count;
-    Indices.clear();
-    Indices.resize(IdxCnt);
-    for (unsigned int i=0; i<IdxCnt; ++i)
-    {
-        Indices[i] = indices[i];
-    }
+    Indices.assign(indices, indices + IdxCnt);
 }
 
 const std::vector<glm::vec3>& MeshBuffer::getVerts() const
@@ -348,9 +1020,41 @@ const std::vector<uint32_t>& MeshBuffer::getIndices() const
     return Indices;
 }
 
+const glm::vec3* MeshBuffer::getVertData() const
+{
+    if (Mapping) return Mapped.verts;
+    return Verts.empty() ? 0 : &Verts[0];
+}
+
+const glm::vec3* MeshBuffer::getNormData() const
+{
+    if (Mapping) return Mapped.norms;
+    return Norms.empty() ? 0 : &Norms[0];
+}
+
+const glm::vec2* MeshBuffer::getTexCoordData() const
+{
+    if (Mapping) return Mapped.texCoords;
+    return TexCoords.empty() ? 0 : &TexCoords[0];
+}
+
+const glm::vec4* MeshBuffer::getGenericData(unsigned int index) const
+{
+    if (index >= Generics.size()) return 0;
+    if (Mapping) return Mapped.generics[index];
+    return Generics[index].empty() ? 0 : &Generics[index][0];
+}
+
+const uint32_t* MeshBuffer::getIndexData() const
+{
+    if (Mapping) return Mapped.indices;
+    return Indices.empty() ? 0 : &Indices[0];
+}
+
 void MeshBuffer::generateFaceNormals()
 {
     assert(IdxCnt);
+    detach();
 
     UsesNormals = true;
     Norms.clear();
@@ -378,6 +1082,26 @@ void MeshBuffer::generateFaceNormals()
     }
 }
 
+void MeshBuffer::remapVertices(const uint32_t* remap)
+{
+    detach();
+
+    // every attribute is permuted in place by walking the cycles of remap,
+    // so the only extra memory is one visited bit per vertex
+    std::vector<bool> visited;
+    permuteInPlace(Verts, remap, visited);
+    if (UsesNormals)
+        permuteInPlace(Norms, remap, visited);
+    if (UsesUVs)
+        permuteInPlace(TexCoords, remap, visited);
+    for (size_t i=0; i<Generics.size(); ++i)
+        if (UsesGenerics[i])
+            permuteInPlace(Generics[i], remap, visited);
+
+    for (unsigned int i=0; i<IdxCnt; ++i)
+        Indices[i] = remap[Indices[i]];
+}
+
 unsigned int MeshBuffer::getVertCnt() const
 {
     return VertCnt;
@@ -401,7 +1125,33 @@ void MeshBuffer::cleanUp()
     TexCoords.clear();
     for (auto& gen: Generics)
         gen.clear();
-    Generics.clear();
+    // keep the layers themselves around so setGenerics still has a slot
+    UsesGenerics.assign(UsesGenerics.size(), false);
 
     Indices.clear();
+
+    delete Mapping;
+    Mapping = 0;
+    memset(&Mapped, 0, sizeof(Mapped));
+}
+
+void MeshBuffer::detach()
+{
+    // copies whatever a mapped file provided into the buffer's own storage
+    if (!Mapping) return;
+
+    Verts.assign(Mapped.verts, Mapped.verts + VertCnt);
+    if (Mapped.norms)
+        Norms.assign(Mapped.norms, Mapped.norms + VertCnt);
+    if (Mapped.texCoords)
+        TexCoords.assign(Mapped.texCoords, Mapped.texCoords + VertCnt);
+    for (size_t i=0; i<Generics.size(); ++i)
+        if (Mapped.generics[i])
+            Generics[i].assign(Mapped.generics[i], Mapped.generics[i] + VertCnt);
+    if (Mapped.indices)
+        Indices.assign(Mapped.indices, Mapped.indices + IdxCnt);
+
+    delete Mapping;
+    Mapping = 0;
+    memset(&Mapped, 0, sizeof(Mapped));
 }
@@ -7,6 +7,8 @@
 #include <vector>
 #include "glm/glm/glm.hpp"
 
+class MappedFile;
+
 class MeshBuffer
 {
 public:
@@ -16,9 +18,27 @@ public:
     MeshBuffer(const MeshBuffer & ref);
     MeshBuffer& operator=(const MeshBuffer & ref);
 
-    void loadFileObj(const char * fileName);
+    // threads parse line aligned chunks of the file, 0 for one per core
+    void loadFileObj(const char * fileName, unsigned int threads = 0);
     void loadFileStl(const char * fileName);
 
+    // Versioned binary cache of this buffer. Loading maps the file and the
+    // buffer views it in place, nothing is copied until the buffer is
+    // changed. While viewing a file the std::vector getters are empty,
+    // use the get*Data accessors, which work for both. OptimizedSettings
+    // is up to the writer: whatever tells a later run whether
+    // OptimizedIndices is still the order it would compute.
+    enum BinExtra { OptimizedIndices, AdjacencyOffsets, AdjacencyTris, OptimizedSettings, BinExtraCount };
+    struct BinSection
+    {
+        const uint32_t* data;
+        uint32_t count;
+    };
+    void loadFileBin(const char * fileName);
+    // extras is null or BinExtraCount sections, leave count at 0 to skip one
+    void saveFileBin(const char * fileName, const BinSection* extras = 0) const;
+    BinSection getBinExtra(BinExtra extra) const;
+
     void setVerts(unsigned int count, const float* verts);
     void setNorms(unsigned int count, const float* normals);
     void setTexCoords(unsigned int layer, unsigned int count, const float* coords);
@@ -29,6 +49,12 @@ public:
     const std::vector<glm::vec2>& getTexCoords(unsigned int layer) const;
     const std::vector<uint32_t>& getIndices() const;
 
+    const glm::vec3* getVertData() const;
+    const glm::vec3* getNormData() const;
+    const glm::vec2* getTexCoordData() const;
+    const glm::vec4* getGenericData(unsigned int index) const;
+    const uint32_t* getIndexData() const;
+
     void setGenerics(unsigned int index, const std::vector<glm::vec4>& values);
     const std::vector<glm::vec4>& getGenerics(unsigned int index) const;
 
@@ -37,6 +63,10 @@ public:
 
     void generateFaceNormals();
 
+    // moves vertex i to remap[i] in every attribute and rewrites the
+    // indices to match. remap has to be a permutation of [0, VertCnt).
+    void remapVertices(const uint32_t* remap);
+
     bool UsesNormals;
     bool UsesUVs;
     bool UsesIndices;
@@ -45,6 +75,7 @@ public:
 private:
 
     void cleanUp();
+    void detach();
 
     unsigned int VertCnt;
     unsigned int IdxCnt;
@@ -58,6 +89,18 @@ private:
     std::vector<std::vector<glm::vec4>> Generics;
 
     std::vector<uint32_t>  Indices;
+
+    // set while the buffer views a file from loadFileBin
+    MappedFile* Mapping;
+    struct MappedData
+    {
+        const glm::vec3* verts;
+        const glm::vec3* norms;
+        const glm::vec2* texCoords;
+        const glm::vec4* generics[5];
+        const uint32_t* indices;
+        BinSection extras[BinExtraCount];
+    } Mapped;
 };
 
 #endif // MESH_BUFFER_H_
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cstring>
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "meshfiles.h"
+
+using namespace std;
+using namespace sp;
+
+double sp::elapsedMs(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+bool sp::hasExtension(const string& path, const char* ext)
+{
+    size_t len = strlen(ext);
+    if (path.size() < len) return false;
+    return strcasecmp(path.c_str() + path.size() - len, ext) == 0;
+}
+
+bool sp::isMesh(const string& path)
+{
+    return hasExtension(path, ".obj") || hasExtension(path, ".stl");
+}
+
+void sp::collectInputs(const char* arg, vector<string>& files)
+{
+    struct stat info;
+    if (stat(arg, &info) != 0) {
+        logMessage(LogError, "Can't open %s", arg);
+        return;
+    }
+
+    if (!S_ISDIR(info.st_mode)) {
+        files.push_back(arg);
+        return;
+    }
+
+    DIR* dir = opendir(arg);
+    if (!dir) {
+        logMessage(LogError, "Can't read directory %s", arg);
+        return;
+    }
+
+    vector<string> found;
+    string base(arg);
+    if (!base.empty() && base[base.size() - 1] != '/') base += '/';
+    while (struct dirent* entry = readdir(dir)) {
+        string path = base + entry->d_name;
+        if (isMesh(path)) found.push_back(path);
+    }
+    closedir(dir);
+
+    sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+bool sp::loadMesh(MeshBuffer& buffer, const string& input, unsigned int threads)
+{
+    if (hasExtension(input, ".stl"))
+        buffer.loadFileStl(input.c_str());
+    else
+        buffer.loadFileObj(input.c_str(), threads);
+    return buffer.getIdxCnt() > 0;
+}
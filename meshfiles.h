@@ -0,0 +1,33 @@
+// Finding and loading the meshes the command line tools are given
+
+#ifndef MESHFILES_H
+#define MESHFILES_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "meshbuffer.h"
+
+namespace sp
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    double elapsedMs(Clock::time_point start);
+
+    // case insensitive, ext includes the dot
+    bool hasExtension(const std::string& path, const char* ext);
+
+    // .obj or .stl
+    bool isMesh(const std::string& path);
+
+    // Appends arg to files, or the meshes directly inside it when it is a
+    // directory, sorted so two runs list them in the same order. Paths that
+    // can't be opened are logged at LogError and left out.
+    void collectInputs(const char* arg, std::vector<std::string>& files);
+
+    // Loads an .stl or .obj by its extension, threads is passed on to
+    // loadFileObj. false when the mesh has no triangles.
+    bool loadMesh(MeshBuffer& buffer, const std::string& input, unsigned int threads = 0);
+}
+#endif // MESHFILES_H
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "lrucache.h"
+#include "overdraw.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    enum { MaxCacheSize = 64, ViewCount = 16, Resolution = 256 };
+
+    typedef LruCache<MaxCacheSize> Cache;
+
+    // number of corners of triangle tri that weren't in the cache
+    int touchTriangle(Cache& cache, const unsigned int* indices, unsigned int tri)
+    {
+        int misses = 0;
+        for (int k=0; k<3; ++k) {
+            int vert = (int)indices[tri * 3 + k];
+            int evicted;
+            if (cache.find(vert) < 0) misses++;
+            cache.touch(vert, evicted);
+        }
+        return misses;
+    }
+
+    float measureAcmr(const unsigned int* indices, unsigned int tri_count, unsigned int cache_size)
+    {
+        if (tri_count == 0) return 0.0f;
+
+        Cache cache;
+        cache.setLimit((int)cache_size);
+        unsigned long long misses = 0;
+        for (unsigned int i=0; i<tri_count; ++i)
+            misses += touchTriangle(cache, indices, i);
+        return (float)misses / tri_count;
+    }
+
+    struct Cluster
+    {
+        unsigned int first;
+        unsigned int last;
+        float key;
+    };
+
+    struct KeyGreater
+    {
+        bool operator()(const Cluster& a, const Cluster& b) const
+        {
+            return a.key > b.key;
+        }
+    };
+
+    void softSplit(const unsigned int* indices, unsigned int first, unsigned int last,
+                   unsigned int cache_size, float threshold, vector<Cluster>& clusters)
+    {
+        float limit = threshold * measureAcmr(indices + first * 3, last - first, cache_size);
+
+        Cache cache;
+        cache.setLimit((int)cache_size);
+        unsigned int start = first;
+        unsigned int misses = 0;
+        for (unsigned int i=first; i<last; ++i) {
+            misses += touchTriangle(cache, indices, i);
+
+            // starting over here costs no more than the threshold allows
+            if ((float)misses / (i + 1 - start) <= limit) {
+                Cluster cluster = { start, i + 1, 0.0f };
+                clusters.push_back(cluster);
+                start = i + 1;
+                misses = 0;
+                cache.clear();
+            }
+        }
+
+        if (start < last) {
+            Cluster cluster = { start, last, 0.0f };
+            clusters.push_back(cluster);
+        }
+    }
+
+    glm::vec3 faceCross(const glm::vec3* positions, const unsigned int* indices, unsigned int tri)
+    {
+        const glm::vec3& a = positions[indices[tri * 3 + 0]];
+        const glm::vec3& b = positions[indices[tri * 3 + 1]];
+        const glm::vec3& c = positions[indices[tri * 3 + 2]];
+        return glm::cross(b - a, c - a);
+    }
+
+    // area weighted centroid over tris[first, last), also returns the area
+    glm::vec3 centroid(const glm::vec3* positions, const unsigned int* indices,
+                       unsigned int first, unsigned int last, float& area)
+    {
+        glm::vec3 sum(0.0f);
+        area = 0.0f;
+        for (unsigned int i=first; i<last; ++i) {
+            float a = glm::length(faceCross(positions, indices, i));
+            glm::vec3 mid = positions[indices[i * 3 + 0]] + positions[indices[i * 3 + 1]] + positions[indices[i * 3 + 2]];
+            sum += mid * (a / 3.0f);
+            area += a;
+        }
+        return area > 0.0f ? sum / area : sum;
+    }
+
+    struct Rasterizer
+    {
+        vector<float> depth;
+        unsigned long long shaded;
+        unsigned long long covered;
+
+        // x, y in pixels, z grows away from the viewer
+        void triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+        {
+            float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+            // back facing or degenerate
+            if (area <= 0.0f) return;
+
+            int x0 = max(0, (int)floorf(min(a[0], min(b[0], c[0]))));
+            int x1 = min(Resolution - 1, (int)ceilf(max(a[0], max(b[0], c[0]))));
+            int y0 = max(0, (int)floorf(min(a[1], min(b[1], c[1]))));
+            int y1 = min(Resolution - 1, (int)ceilf(max(a[1], max(b[1], c[1]))));
+
+            float inv = 1.0f / area;
+            for (int y=y0; y<=y1; ++y) {
+                float py = y + 0.5f;
+                for (int x=x0; x<=x1; ++x) {
+                    float px = x + 0.5f;
+                    float w0 = (c[0] - b[0]) * (py - b[1]) - (c[1] - b[1]) * (px - b[0]);
+                    float w1 = (a[0] - c[0]) * (py - c[1]) - (a[1] - c[1]) * (px - c[0]);
+                    float w2 = (b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0]);
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+                    float z = (w0 * a[2] + w1 * b[2] + w2 * c[2]) * inv;
+                    float& stored = depth[y * Resolution + x];
+                    if (z < stored) {
+                        if (stored == HUGE_VALF) covered++;
+                        stored = z;
+                        shaded++;
+                    }
+                }
+            }
+        }
+    };
+}
+
+OverdrawOptions::OverdrawOptions()
+    : cache_size(32)
+    , threshold(1.05f)
+{
+}
+
+float sp::sampleOverdraw(const MeshBuffer& buffer, const unsigned int* indices, unsigned int count)
+{
+    const glm::vec3* positions = buffer.getVertData();
+    unsigned int vert_cnt = buffer.getVertCnt();
+    unsigned int tri_count = count / 3;
+    if (tri_count == 0 || vert_cnt == 0) return 0.0f;
+
+    glm::vec3 low = positions[0];
+    glm::vec3 high = low;
+    for (unsigned int i=1; i<vert_cnt; ++i) {
+        for (int k=0; k<3; ++k) {
+            low[k] = min(low[k], positions[i][k]);
+            high[k] = max(high[k], positions[i][k]);
+        }
+    }
+    glm::vec3 middle = (low + high) * 0.5f;
+    float radius = glm::length(high - low) * 0.5f;
+    if (radius <= 0.0f) return 0.0f;
+    float scale = Resolution / (2.0f * radius);
+
+    Rasterizer raster;
+    raster.shaded = 0;
+    raster.covered = 0;
+    vector<glm::vec3> projected(vert_cnt);
+
+    // directions spread evenly over the sphere
+    for (int view=0; view<ViewCount; ++view) {
+        float z = 1.0f - (2.0f * view + 1.0f) / ViewCount;
+        float r = sqrtf(1.0f - z * z);
+        float phi = view * 2.39996323f;
+        glm::vec3 dir(r * cosf(phi), r * sinf(phi), z);
+
+        glm::vec3 side = fabsf(dir[0]) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 up = glm::normalize(glm::cross(dir, side));
+        side = glm::cross(up, dir);
+
+        // looking down dir, so depth is the distance along it. side points
+        // to the viewer's left, x is flipped to keep front faces counter
+        // clockwise on screen.
+        for (unsigned int i=0; i<vert_cnt; ++i) {
+            glm::vec3 p = positions[i] - middle;
+            projected[i] = glm::vec3((radius - glm::dot(p, side)) * scale,
+                                     (glm::dot(p, up) + radius) * scale,
+                                     glm::dot(p, dir));
+        }
+
+        raster.depth.assign(Resolution * Resolution, HUGE_VALF);
+        for (unsigned int i=0; i<tri_count; ++i)
+            raster.triangle(projected[indices[i * 3 + 0]], projected[indices[i * 3 + 1]], projected[indices[i * 3 + 2]]);
+    }
+
+    return raster.covered ? (float)raster.shaded / raster.covered : 0.0f;
+}
+
+OverdrawResult sp::optimizeOverdraw(const MeshBuffer& buffer, const OverdrawOptions& options,
+                                    unsigned int* indices, unsigned int count)
+{
+    OverdrawResult result;
+    unsigned int tri_count = count / 3;
+    unsigned int cache_size = max(1u, min(options.cache_size, (unsigned int)MaxCacheSize));
+
+    result.clusters = 0;
+    result.acmr_before = measureAcmr(indices, tri_count, cache_size);
+    result.overdraw_before = sampleOverdraw(buffer, indices, count);
+    result.acmr_after = result.acmr_before;
+    result.overdraw_after = result.overdraw_before;
+    if (tri_count == 0) return result;
+
+    // hard boundaries, where the optimizer had to jump somewhere cold
+    vector<Cluster> clusters;
+    Cache cache;
+    cache.setLimit((int)cache_size);
+    unsigned int start = 0;
+    for (unsigned int i=0; i<tri_count; ++i) {
+        if (touchTriangle(cache, indices, i) == 3 && i > start) {
+            softSplit(indices, start, i, cache_size, options.threshold, clusters);
+            start = i;
+        }
+    }
+    softSplit(indices, start, tri_count, cache_size, options.threshold, clusters);
+
+    const glm::vec3* positions = buffer.getVertData();
+    float mesh_area;
+    glm::vec3 mesh_centroid = centroid(positions, indices, 0, tri_count, mesh_area);
+
+    for (size_t c=0; c<clusters.size(); ++c) {
+        glm::vec3 normal(0.0f);
+        for (unsigned int i=clusters[c].first; i<clusters[c].last; ++i)
+            normal += faceCross(positions, indices, i);
+        float normal_length = glm::length(normal);
+        if (normal_length > 0.0f) normal /= normal_length;
+
+        float area;
+        glm::vec3 middle = centroid(positions, indices, clusters[c].first, clusters[c].last, area);
+        clusters[c].key = glm::dot(middle - mesh_centroid, normal);
+    }
+
+    // stable, so clusters that tie keep the cache order
+    stable_sort(clusters.begin(), clusters.end(), KeyGreater());
+
+    vector<unsigned int> sorted;
+    sorted.reserve(tri_count * 3);
+    for (size_t c=0; c<clusters.size(); ++c)
+        sorted.insert(sorted.end(), indices + clusters[c].first * 3, indices + clusters[c].last * 3);
+
+    // a closed surface in one cluster has normals that cancel out and a
+    // meaningless key, so only keep the new order if it actually helps
+    float acmr = measureAcmr(&sorted[0], tri_count, cache_size);
+    float overdraw = sampleOverdraw(buffer, &sorted[0], count);
+    if (overdraw >= result.overdraw_before || acmr > result.acmr_before * options.threshold)
+        return result;
+
+    copy(sorted.begin(), sorted.end(), indices);
+    result.clusters = (unsigned int)clusters.size();
+    result.acmr_after = acmr;
+    result.overdraw_after = overdraw;
+    return result;
+}
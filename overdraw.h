@@ -0,0 +1,47 @@
+// Reorders the clusters of an optimized triangle list to cut overdraw
+
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include "meshbuffer.h"
+
+namespace sp
+{
+    struct OverdrawOptions
+    {
+        OverdrawOptions();
+
+        unsigned int cache_size;    // LRU entries the ACMR is measured with
+        float threshold;            // clusters may have up to this times the ACMR they had
+    };
+
+    struct OverdrawResult
+    {
+        unsigned int clusters;
+        float acmr_before;
+        float acmr_after;
+        float overdraw_before;      // see sampleOverdraw
+        float overdraw_after;
+    };
+
+    // Takes the output of vcache::optimize and cuts it into clusters where
+    // the cache starts over (all three corners of a triangle miss). Those
+    // are cut again wherever their running ACMR drops to threshold times
+    // the ACMR of the whole cluster, so every piece starts with a cold cache
+    // at a cost the threshold bounds.
+    //
+    // The clusters are then drawn in order of how far they face out from
+    // the middle of the mesh, dot(centroid - mesh centroid, normal), largest
+    // first. Outward facing parts tend to hide the rest from most views,
+    // so this works without knowing the camera. indices is reordered in
+    // place, and left alone (with clusters at 0) when the sampled overdraw
+    // doesn't improve or the whole mesh ends up over the threshold.
+    OverdrawResult optimizeOverdraw(const MeshBuffer& buffer, const OverdrawOptions& options,
+                                    unsigned int* indices, unsigned int count);
+
+    // Renders the triangles from a fixed set of directions around the mesh
+    // with back face culling and a depth test, and returns the fragments
+    // that passed the test per covered pixel. 1 means nothing is drawn twice.
+    float sampleOverdraw(const MeshBuffer& buffer, const unsigned int* indices, unsigned int count);
+}
+#endif // OVERDRAW_H
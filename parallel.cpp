@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "parallel.h"
+#include "vcache.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    struct CentroidLess
+    {
+        const vector<glm::vec3>* centroids;
+        int axis;
+
+        bool operator()(unsigned int a, unsigned int b) const
+        {
+            return (*centroids)[a][axis] < (*centroids)[b][axis];
+        }
+    };
+
+    // splits tris[first, last) into count clusters, appending where each
+    // one ends to bounds. clusters come out in kd-tree leaf order.
+    void split(vector<unsigned int>& tris, const vector<glm::vec3>& centroids,
+               unsigned int first, unsigned int last, unsigned int count,
+               vector<unsigned int>& bounds)
+    {
+        if (count <= 1 || last - first < 2) {
+            bounds.push_back(last);
+            return;
+        }
+
+        glm::vec3 low = centroids[tris[first]];
+        glm::vec3 high = low;
+        for (unsigned int i=first+1; i<last; ++i) {
+            const glm::vec3& c = centroids[tris[i]];
+            for (int k=0; k<3; ++k) {
+                if (c[k] < low[k]) low[k] = c[k];
+                if (c[k] > high[k]) high[k] = c[k];
+            }
+        }
+
+        CentroidLess less;
+        less.centroids = &centroids;
+        less.axis = 0;
+        for (int k=1; k<3; ++k)
+            if (high[k] - low[k] > high[less.axis] - low[less.axis]) less.axis = k;
+
+        // uneven counts split the triangles in the same ratio
+        unsigned int left_count = count / 2;
+        unsigned int mid = first + (unsigned int)((unsigned long long)(last - first) * left_count / count);
+        nth_element(tris.begin() + first, tris.begin() + mid, tris.begin() + last, less);
+
+        split(tris, centroids, first, mid, left_count, bounds);
+        split(tris, centroids, mid, last, count - left_count, bounds);
+    }
+
+    // every extra cluster touching a vertex is one more fetch than the serial order needs
+    unsigned long long seamMisses(const vector<unsigned int>& tris, const vector<unsigned int>& bounds,
+                                  const uint32_t* indices, unsigned int vert_cnt)
+    {
+        vector<int> last_cluster(vert_cnt, -1);
+        unsigned long long misses = 0;
+
+        unsigned int first = 0;
+        for (int c=0; c<(int)bounds.size(); ++c) {
+            for (unsigned int i=first; i<bounds[c]; ++i) {
+                for (int k=0; k<3; ++k) {
+                    unsigned int vert_idx = indices[tris[i] * 3 + k];
+                    if (last_cluster[vert_idx] == c) continue;
+                    if (last_cluster[vert_idx] >= 0) misses++;
+                    last_cluster[vert_idx] = c;
+                }
+            }
+            first = bounds[c];
+        }
+        return misses;
+    }
+
+    struct Job
+    {
+        const uint32_t* indices;
+        const VcacheParams* params;
+        const vector<unsigned int>* tris;
+        const vector<unsigned int>* bounds;
+        vector<unsigned int>* result;
+        atomic<unsigned int> next;
+        atomic<bool> failed;
+    };
+
+    void worker(Job* job)
+    {
+        vcache optimizer;
+        optimizer.setParams(*job->params);
+        vector<unsigned int> verts;
+        vector<unsigned int> local;
+
+        const uint32_t* indices = job->indices;
+        const vector<unsigned int>& tris = *job->tris;
+        const vector<unsigned int>& bounds = *job->bounds;
+
+        while (true) {
+            unsigned int c = job->next++;
+            if (c >= bounds.size()) break;
+
+            unsigned int first = c == 0 ? 0 : bounds[c - 1];
+            unsigned int last = bounds[c];
+
+            // give the cluster its own dense vertex range
+            verts.clear();
+            for (unsigned int i=first; i<last; ++i)
+                for (int k=0; k<3; ++k)
+                    verts.push_back(indices[tris[i] * 3 + k]);
+            sort(verts.begin(), verts.end());
+            verts.erase(unique(verts.begin(), verts.end()), verts.end());
+
+            local.clear();
+            for (unsigned int i=first; i<last; ++i) {
+                for (int k=0; k<3; ++k) {
+                    unsigned int vert_idx = indices[tris[i] * 3 + k];
+                    local.push_back((unsigned int)(lower_bound(verts.begin(), verts.end(), vert_idx) - verts.begin()));
+                }
+            }
+
+            optimizer.optimize(&local[0], (unsigned int)local.size(), (unsigned int)verts.size());
+            if (optimizer.getIndexCount() != local.size()) {
+                job->failed = true;
+                break;
+            }
+
+            // clusters own disjoint ranges of the output, no locking needed
+            const unsigned int* order = optimizer.getIndices();
+            unsigned int* out = &(*job->result)[first * 3];
+            for (unsigned int i=0; i<optimizer.getIndexCount(); ++i)
+                out[i] = verts[order[i]];
+        }
+    }
+}
+
+ParallelOptions::ParallelOptions()
+    : threads(0)
+    , min_cluster_tris(4096)
+    , acmr_tolerance(0.01f)
+{
+}
+
+ParallelResult sp::optimizeParallel(const MeshBuffer& buffer, const ParallelOptions& options,
+                                    vector<unsigned int>& indices)
+{
+    ParallelResult result;
+    result.clusters = 0;
+    result.seam_acmr = 0.0f;
+
+    const uint32_t* src = buffer.getIndexData();
+    const glm::vec3* positions = buffer.getVertData();
+    unsigned int tri_count = buffer.getIdxCnt() / 3;
+    indices.resize(tri_count * 3);
+    if (tri_count == 0) return result;
+
+    unsigned int threads = options.threads;
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    unsigned int clusters = threads;
+    unsigned int min_tris = max(options.min_cluster_tris, 1u);
+    if (clusters > tri_count / min_tris) clusters = max(tri_count / min_tris, 1u);
+
+    vector<glm::vec3> centroids(tri_count);
+    for (unsigned int i=0; i<tri_count; ++i) {
+        const glm::vec3& a = positions[src[i * 3 + 0]];
+        const glm::vec3& b = positions[src[i * 3 + 1]];
+        const glm::vec3& c = positions[src[i * 3 + 2]];
+        for (int k=0; k<3; ++k)
+            centroids[i][k] = (a[k] + b[k] + c[k]) * (1.0f / 3.0f);
+    }
+
+    vector<unsigned int> tris(tri_count);
+    vector<unsigned int> bounds;
+    while (true) {
+        for (unsigned int i=0; i<tri_count; ++i) tris[i] = i;
+        bounds.clear();
+        split(tris, centroids, 0, tri_count, clusters, bounds);
+
+        unsigned long long misses = clusters > 1 ? seamMisses(tris, bounds, src, buffer.getVertCnt()) : 0;
+        result.seam_acmr = (float)misses / tri_count;
+        if (clusters == 1 || result.seam_acmr <= options.acmr_tolerance) break;
+        clusters /= 2;
+    }
+    result.clusters = (unsigned int)bounds.size();
+
+    Job job;
+    job.indices = src;
+    job.params = &options.params;
+    job.tris = &tris;
+    job.bounds = &bounds;
+    job.result = &indices;
+    job.next = 0;
+    job.failed = false;
+
+    unsigned int workers = min(threads, result.clusters);
+    vector<thread> pool;
+    for (unsigned int i=1; i<workers; ++i)
+        pool.push_back(thread(worker, &job));
+    worker(&job);
+    for (size_t i=0; i<pool.size(); ++i)
+        pool[i].join();
+
+    if (job.failed) {
+        indices.clear();
+        result.clusters = 0;
+    }
+    return result;
+}
@@ -0,0 +1,43 @@
+// Splits one mesh into spatial clusters and optimizes them side by side
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <vector>
+
+#include "meshbuffer.h"
+#include "vcache.h"
+
+namespace sp
+{
+    struct ParallelOptions
+    {
+        ParallelOptions();
+
+        unsigned int threads;           // 0 uses every core
+        unsigned int min_cluster_tris;  // clusters never get smaller than this
+        float acmr_tolerance;           // most ACMR the seams between clusters may add
+        VcacheParams params;            // used for every cluster
+    };
+
+    struct ParallelResult
+    {
+        unsigned int clusters;
+        float seam_acmr;                // estimated ACMR added by the seams
+    };
+
+    // The triangles are split by recursive median cuts of their centroids
+    // along the longest axis, one cluster per thread. Every cluster is run
+    // through its own vcache and the results are laid out in kd-tree leaf
+    // order, so neighbouring clusters stay next to each other in the stream.
+    //
+    // A vertex used by n clusters gets fetched n times instead of once, so
+    // the extra misses are known up front. The cluster count is halved until
+    // that estimate fits in acmr_tolerance.
+    //
+    // When a cluster can't be optimized (out of memory, logged by vcache)
+    // indices comes back empty and clusters is 0.
+    ParallelResult optimizeParallel(const MeshBuffer& buffer, const ParallelOptions& options,
+                                    std::vector<unsigned int>& indices);
+}
+#endif // PARALLEL_H
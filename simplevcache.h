@@ -0,0 +1,41 @@
+// Everything libvcache offers, for code linking the library
+
+#ifndef SIMPLE_VCACHE_H
+#define SIMPLE_VCACHE_H
+
+// bumped when a declaration in these headers changes in a way that breaks
+// code built against an older version
+#define SP_VCACHE_VERSION_MAJOR 1
+#define SP_VCACHE_VERSION_MINOR 0
+
+// Every entry point takes plain index arrays: triangles as idx_cnt indices
+// into [0, vert_cnt), 32-bit unless stated otherwise. vcache also takes
+// 16-bit indices and can write its result back over them, so indices
+// already in an engine's buffers never have to go through a MeshBuffer.
+//
+//   vcache              triangle order for the post transform cache
+//   analyzer            ACMR and ATVR for FIFO, LRU and batch caches
+//   encodeIndices       index compression, decodeIndices to read it back
+//   splitMesh           sub-meshes addressable with 16-bit indices
+//   tuneParams          VcacheParams fitted to a set of meshes
+//
+// The passes that need positions, optimizeParallel, optimizeOverdraw and
+// optimizeVertexFetch, take a MeshBuffer, and optimizeStream works from
+// file to file. collectInputs and loadMesh find and read meshes the way
+// the command line tools do. Nothing is printed, messages go
+// to the callback given to setLogCallback.
+#include "analyzer.h"
+#include "cachemodel.h"
+#include "indexcodec.h"
+#include "log.h"
+#include "meshbuffer.h"
+#include "meshfiles.h"
+#include "overdraw.h"
+#include "parallel.h"
+#include "stream.h"
+#include "submesh.h"
+#include "tune.h"
+#include "vcache.h"
+#include "vertexfetch.h"
+
+#endif // SIMPLE_VCACHE_H
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "stream.h"
+#include "vcache.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    enum { LineSize = 4096 };
+
+    bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    // reads a whole line, however long, into line and null terminates it.
+    // the buffer doubles whenever fgets fills it without reaching the end
+    // of the line. false at the end of the file.
+    bool readLine(FILE* file, vector<char>& line)
+    {
+        if (line.size() < LineSize) line.resize(LineSize);
+
+        size_t len = 0;
+        while (fgets(&line[len], (int)(line.size() - len), file)) {
+            len += strlen(&line[len]);
+            if (len + 1 < line.size() || line[len - 1] == '\n') return true;
+            line.resize(line.size() * 2);
+        }
+        return len > 0;
+    }
+
+    // reads faces one line at a time, counting "v" lines to resolve the
+    // negative (relative) indices
+    struct FaceReader
+    {
+        FILE* file;
+        unsigned long long verts;       // read so far
+        unsigned long long total_verts; // in the whole file
+        vector<char> line;
+        vector<long long> polygon;
+        unsigned long long skipped;     // faces with too few or bad indices
+
+        // appends the triangles of the next face to tris, false at the end
+        bool next(vector<unsigned int>& tris)
+        {
+            while (readLine(file, line)) {
+                if (line[0] == 'v' && isBlank(line[1])) {
+                    verts++;
+                    continue;
+                }
+                if (line[0] != 'f' || !isBlank(line[1])) continue;
+
+                polygon.clear();
+                char* q = &line[1];
+                while (true) {
+                    while (isBlank(*q)) ++q;
+                    char* end;
+                    long long index = strtoll(q, &end, 10);
+                    if (end == q) break;
+                    // 1 based, negative counts back from the last vertex read
+                    polygon.push_back(index < 0 ? (long long)verts + index : index - 1);
+                    // skip the texcoord and normal indices of the corner
+                    q = end;
+                    while (*q && !isBlank(*q) && *q != '\n' && *q != '\r') ++q;
+                }
+
+                bool ok = polygon.size() >= 3;
+                for (size_t i=0; ok && i<polygon.size(); ++i)
+                    ok = polygon[i] >= 0 && (unsigned long long)polygon[i] < total_verts;
+                if (!ok) {
+                    skipped++;
+                    continue;
+                }
+
+                // polygons are split into a fan around their first corner
+                for (size_t i=2; i<polygon.size(); ++i) {
+                    tris.push_back((unsigned int)polygon[0]);
+                    tris.push_back((unsigned int)polygon[i - 1]);
+                    tris.push_back((unsigned int)polygon[i]);
+                }
+                return true;
+            }
+            return false;
+        }
+    };
+
+    // optimizes window in place, verts and local are scratch
+    void optimizeWindow(vcache& optimizer, vector<unsigned int>& window,
+                        vector<unsigned int>& verts, vector<unsigned int>& local)
+    {
+        verts.assign(window.begin(), window.end());
+        sort(verts.begin(), verts.end());
+        verts.erase(unique(verts.begin(), verts.end()), verts.end());
+
+        local.resize(window.size());
+        for (size_t i=0; i<window.size(); ++i)
+            local[i] = (unsigned int)(lower_bound(verts.begin(), verts.end(), window[i]) - verts.begin());
+
+        optimizer.optimize(&local[0], (unsigned int)local.size(), (unsigned int)verts.size());
+
+        const unsigned int* order = optimizer.getIndices();
+        for (unsigned int i=0; i<optimizer.getIndexCount(); ++i)
+            window[i] = verts[order[i]];
+    }
+
+    void writeFaces(FILE* out_file, const unsigned int* tris, size_t count)
+    {
+        // faces start at 1, not 0
+        for (size_t i=0; i+2<count; i+=3)
+            fprintf(out_file, "f %u %u %u\n", tris[i] + 1, tris[i + 1] + 1, tris[i + 2] + 1);
+    }
+}
+
+StreamOptions::StreamOptions()
+    : window_tris(1 << 18)
+{
+}
+
+bool sp::optimizeStream(const char* in_path, const char* out_path, const StreamOptions& options,
+                        StreamResult& result)
+{
+    result.verts = 0;
+    result.triangles = 0;
+    result.windows = 0;
+    result.skipped = 0;
+
+    FILE* in_file = fopen(in_path, "r");
+    if (!in_file) return false;
+
+    FILE* out_file = fopen(out_path, "w");
+    if (!out_file) {
+        fclose(in_file);
+        return false;
+    }
+
+    // first pass, the positions go straight through
+    vector<char> line;
+    while (readLine(in_file, line)) {
+        if (line[0] == 'v' && isBlank(line[1])) {
+            fputs(&line[0], out_file);
+            // the last line of the file may have no newline, the faces follow it
+            size_t len = strlen(&line[0]);
+            if (line[len - 1] != '\n') fputc('\n', out_file);
+            result.verts++;
+        }
+    }
+    rewind(in_file);
+
+    FaceReader reader;
+    reader.file = in_file;
+    reader.verts = 0;
+    reader.total_verts = result.verts;
+    reader.skipped = 0;
+
+    const size_t window_size = max(options.window_tris, 2u) * (size_t)3;
+    vector<unsigned int> window;
+    vector<unsigned int> verts;
+    vector<unsigned int> local;
+    window.reserve(window_size + 3 * 16);
+    vcache optimizer;
+    optimizer.setParams(options.params);
+
+    bool more = true;
+    while (true) {
+        while (more && window.size() < window_size)
+            more = reader.next(window);
+        if (window.empty()) break;
+
+        optimizeWindow(optimizer, window, verts, local);
+        result.windows++;
+
+        if (!more) {
+            writeFaces(out_file, &window[0], window.size());
+            result.triangles += window.size() / 3;
+            break;
+        }
+
+        // keep the second half around to be optimized with the next faces
+        size_t emit = (window.size() / 6) * 3;
+        writeFaces(out_file, &window[0], emit);
+        result.triangles += emit / 3;
+        window.erase(window.begin(), window.begin() + emit);
+    }
+
+    result.skipped = reader.skipped;
+    fclose(in_file);
+    return fclose(out_file) == 0;
+}
@@ -0,0 +1,39 @@
+// Optimizes OBJ files too large to load, a window of triangles at a time
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "vcache.h"
+
+namespace sp
+{
+    struct StreamOptions
+    {
+        StreamOptions();
+
+        unsigned int window_tris;       // most triangles held in memory at once
+        VcacheParams params;
+    };
+
+    struct StreamResult
+    {
+        unsigned long long verts;
+        unsigned long long triangles;
+        unsigned long long windows;     // vcache runs, each over at most window_tris
+        unsigned long long skipped;     // faces left out for bad indices
+    };
+
+    // Reads in_path twice and never holds more than a window of it. The first
+    // pass copies the "v" lines over to out_path as they are. The second
+    // reads the faces into a window, renumbers the window's vertices densely
+    // and runs it through vcache. Only the first half of that result is
+    // written, the triangles the optimizer left for last stay in the window
+    // and get another go with the next faces read in.
+    //
+    // The output has positions and triangles only, like the batch tool
+    // writes. Memory grows with window_tris, not with the mesh. Returns
+    // false when either file can't be opened.
+    bool optimizeStream(const char* in_path, const char* out_path, const StreamOptions& options,
+                        StreamResult& result);
+}
+#endif // STREAM_H
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <limits>
+
+#include "submesh.h"
+
+using namespace std;
+using namespace sp;
+
+unsigned int sp::indexBytes(unsigned int vert_cnt)
+{
+    return vert_cnt <= 65536 ? 2 : 4;
+}
+
+template <typename Index>
+void sp::splitMesh(const unsigned int* indices, unsigned int idx_cnt, unsigned int vert_cnt,
+                   unsigned int max_verts, vector<Index>& local,
+                   vector<unsigned int>& verts, vector<SubMesh>& subs)
+{
+    unsigned long long addressable = (unsigned long long)numeric_limits<Index>::max() + 1;
+    max_verts = (unsigned int)min((unsigned long long)max_verts, addressable);
+    max_verts = max(max_verts, 3u);
+
+    unsigned int tri_count = idx_cnt / 3;
+    local.resize(tri_count * 3);
+    verts.clear();
+    subs.clear();
+
+    // which sub-mesh last gave each vertex a local number, and that number
+    vector<unsigned int> owner(vert_cnt, ~0u);
+    vector<unsigned int> slot(vert_cnt);
+
+    SubMesh sub = { 0, 0, 0, 0 };
+    unsigned int current = 0;
+    for (unsigned int i=0; i<tri_count; ++i) {
+        const unsigned int* tri = indices + i * 3;
+
+        unsigned int added = 0;
+        for (int k=0; k<3; ++k) {
+            bool repeat = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+            if (owner[tri[k]] != current && !repeat) added++;
+        }
+
+        if (sub.vert_count + added > max_verts) {
+            subs.push_back(sub);
+            sub.first_index += sub.index_count;
+            sub.first_vert += sub.vert_count;
+            sub.index_count = 0;
+            sub.vert_count = 0;
+            current++;
+        }
+
+        for (int k=0; k<3; ++k) {
+            unsigned int vert = tri[k];
+            if (owner[vert] != current) {
+                owner[vert] = current;
+                slot[vert] = sub.vert_count++;
+                verts.push_back(vert);
+            }
+            local[i * 3 + k] = (Index)slot[vert];
+        }
+        sub.index_count += 3;
+    }
+
+    if (sub.index_count > 0)
+        subs.push_back(sub);
+}
+
+template void sp::splitMesh<uint16_t>(const unsigned int*, unsigned int, unsigned int, unsigned int,
+                                      vector<uint16_t>&, vector<unsigned int>&, vector<SubMesh>&);
+template void sp::splitMesh<uint32_t>(const unsigned int*, unsigned int, unsigned int, unsigned int,
+                                      vector<uint32_t>&, vector<unsigned int>&, vector<SubMesh>&);
@@ -0,0 +1,37 @@
+// Cuts an optimized index list into pieces small enough for 16-bit indices
+
+#ifndef SUB_MESH_H
+#define SUB_MESH_H
+
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+    struct SubMesh
+    {
+        unsigned int first_index;   // into the local indices
+        unsigned int index_count;
+        unsigned int first_vert;    // into the vertex list
+        unsigned int vert_count;
+    };
+
+    // 2 when every index of vert_cnt vertices fits in a uint16_t, else 4
+    unsigned int indexBytes(unsigned int vert_cnt);
+
+    // Walks the triangles in the order given and starts a new sub-mesh
+    // whenever the next triangle would bring more than max_verts vertices
+    // into the current one. Every sub-mesh is a run of the input, so the
+    // cache order inside it is unchanged and its vertices stay close
+    // together. Vertices on the cuts are repeated in both sub-meshes.
+    //
+    // verts gets the source vertex of every sub-mesh vertex, numbered in the
+    // order each sub-mesh first uses them. local gets the triangles with
+    // indices relative to first_vert of their sub-mesh. max_verts is capped
+    // to what Index can address. Index is uint16_t or uint32_t.
+    template <typename Index>
+    void splitMesh(const unsigned int* indices, unsigned int idx_cnt, unsigned int vert_cnt,
+                   unsigned int max_verts, std::vector<Index>& local,
+                   std::vector<unsigned int>& verts, std::vector<SubMesh>& subs);
+}
+#endif // SUB_MESH_H
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <thread>
+
+#include "analyzer.h"
+#include "tune.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    enum { ParamCount = 5 };
+
+    // lower and upper bound and the first step of every parameter
+    const float Limits[ParamCount][3] = {
+        { 0.1f, 4.0f, 0.5f },       // cache_decay_power
+        { 0.05f, 2.0f, 0.25f },     // last_tri_score
+        { 0.1f, 4.0f, 0.5f },       // valence_boost_scale
+        { 0.05f, 2.0f, 0.25f },     // valence_boost_power
+        { 4.0f, 67.0f, 4.0f },      // max_size_cache
+    };
+
+    // steps below these are not worth another round
+    const float MinSteps[ParamCount] = { 0.05f, 0.02f, 0.05f, 0.02f, 1.0f };
+
+    // misses of a set that couldn't be run over the whole corpus, never the best
+    const unsigned long long Invalid = ULLONG_MAX;
+
+    struct Point
+    {
+        float values[ParamCount];
+        CacheModel model;
+
+        VcacheParams params() const
+        {
+            VcacheParams p;
+            p.cache_decay_power = values[0];
+            p.last_tri_score = values[1];
+            p.valence_boost_scale = values[2];
+            p.valence_boost_power = values[3];
+            p.max_size_cache = (int)values[4];
+            p.cache_model = model;
+            return p;
+        }
+    };
+
+    struct Job
+    {
+        const vector<const MeshBuffer*>* corpus;
+        const TuneOptions* options;
+        const vector<Point>* points;
+        vector<atomic<unsigned long long> >* misses;
+        vector<atomic<bool> >* failed;
+        atomic<unsigned int> next;
+    };
+
+    void worker(Job* job)
+    {
+        vcache optimizer;
+        analyzer stats;
+        stats.setCacheSizes(&job->options->cache_size, 1);
+
+        const vector<const MeshBuffer*>& corpus = *job->corpus;
+        unsigned int count = (unsigned int)(job->points->size() * corpus.size());
+        while (true) {
+            unsigned int task = job->next++;
+            if (task >= count) break;
+
+            const Point& point = (*job->points)[task / corpus.size()];
+            const MeshBuffer& mesh = *corpus[task % corpus.size()];
+
+            optimizer.setParams(point.params());
+            optimizer.optimize(mesh.getIndexData(), mesh.getIdxCnt(), mesh.getVertCnt());
+            if (optimizer.getIndexCount() != mesh.getIdxCnt()) {
+                // out of memory, logged by vcache. a partial order would
+                // miss less than a complete one, so the set is out.
+                (*job->failed)[task / corpus.size()] = true;
+                continue;
+            }
+            stats.analyze(optimizer.getIndices(), optimizer.getIndexCount(), mesh.getVertCnt());
+
+            (*job->misses)[task / corpus.size()] += stats.getStats(job->options->model, 0).misses;
+        }
+    }
+
+    // total misses of every point over the corpus, Invalid for the points
+    // that couldn't be optimized on some mesh
+    void evaluate(const vector<const MeshBuffer*>& corpus, const TuneOptions& options,
+                  const vector<Point>& points, vector<unsigned long long>& misses)
+    {
+        vector<atomic<unsigned long long> > totals(points.size());
+        vector<atomic<bool> > failed(points.size());
+        for (size_t i=0; i<totals.size(); ++i) totals[i] = 0;
+        for (size_t i=0; i<failed.size(); ++i) failed[i] = false;
+
+        Job job;
+        job.corpus = &corpus;
+        job.options = &options;
+        job.points = &points;
+        job.misses = &totals;
+        job.failed = &failed;
+        job.next = 0;
+
+        unsigned int threads = options.threads;
+        if (threads == 0) threads = thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+        threads = min(threads, (unsigned int)(points.size() * corpus.size()));
+
+        vector<thread> pool;
+        for (unsigned int i=1; i<threads; ++i)
+            pool.push_back(thread(worker, &job));
+        worker(&job);
+        for (size_t i=0; i<pool.size(); ++i)
+            pool[i].join();
+
+        misses.resize(points.size());
+        for (size_t i=0; i<points.size(); ++i)
+            misses[i] = failed[i] ? Invalid : (unsigned long long)totals[i];
+    }
+}
+
+TuneOptions::TuneOptions()
+    : model(FifoModel)
+    , cache_size(32)
+    , threads(0)
+    , rounds(32)
+{
+}
+
+TuneResult sp::tuneParams(const vector<const MeshBuffer*>& corpus, const TuneOptions& input)
+{
+    TuneOptions options = input;
+    options.cache_size = max(1u, min(options.cache_size, (unsigned int)analyzer::MaxCacheSize));
+
+    VcacheParams defaults;
+    TuneResult result;
+    result.params = defaults;
+    result.acmr = 0.0f;
+    result.default_acmr = 0.0f;
+    result.evaluations = 0;
+
+    unsigned long long tri_count = 0;
+    for (size_t i=0; i<corpus.size(); ++i)
+        tri_count += corpus[i]->getIdxCnt() / 3;
+    if (tri_count == 0) return result;
+
+    Point current;
+    current.values[0] = defaults.cache_decay_power;
+    current.values[1] = defaults.last_tri_score;
+    current.values[2] = defaults.valence_boost_scale;
+    current.values[3] = defaults.valence_boost_power;
+    current.values[4] = (float)defaults.max_size_cache;
+    current.model = defaults.cache_model;
+
+    // the paper's defaults first, then the optimizer modeling the target's
+    // cache model, its size or both. the search keeps the model of the best.
+    vector<Point> points(1, current);
+    Point sized = current;
+    sized.values[4] = (float)min(options.cache_size + 3, (unsigned int)Limits[4][1]);
+    points.push_back(sized);
+    if (options.model != current.model) {
+        current.model = options.model;
+        sized.model = options.model;
+        points.push_back(current);
+        points.push_back(sized);
+    }
+
+    vector<unsigned long long> misses;
+    evaluate(corpus, options, points, misses);
+
+    size_t start = min_element(misses.begin(), misses.end()) - misses.begin();
+    if (misses[start] == Invalid) return result;
+    result.evaluations += (unsigned int)points.size();
+    if (misses[0] != Invalid) result.default_acmr = (float)misses[0] / tri_count;
+    current = points[start];
+    unsigned long long best = misses[start];
+
+    float steps[ParamCount];
+    for (int i=0; i<ParamCount; ++i) steps[i] = Limits[i][2];
+
+    for (unsigned int round=0; round<options.rounds; ++round) {
+        points.clear();
+        for (int i=0; i<ParamCount; ++i) {
+            for (int dir=-1; dir<=1; dir+=2) {
+                Point point = current;
+                float value = current.values[i] + dir * steps[i];
+                value = max(Limits[i][0], min(value, Limits[i][1]));
+                if (value == current.values[i]) continue;
+                point.values[i] = value;
+                points.push_back(point);
+            }
+        }
+        if (points.empty()) break;
+
+        evaluate(corpus, options, points, misses);
+        result.evaluations += (unsigned int)points.size();
+
+        // ties go to the first candidate, so the result is repeatable
+        size_t winner = min_element(misses.begin(), misses.end()) - misses.begin();
+        if (misses[winner] < best) {
+            best = misses[winner];
+            current = points[winner];
+            continue;
+        }
+
+        bool done = true;
+        for (int i=0; i<ParamCount; ++i) {
+            steps[i] *= 0.5f;
+            if (i == 4) steps[i] = floorf(steps[i]);
+            if (steps[i] >= MinSteps[i]) done = false;
+        }
+        if (done) break;
+    }
+
+    result.params = current.params();
+    result.acmr = (float)best / tri_count;
+    return result;
+}
@@ -0,0 +1,41 @@
+// Searches the vcache parameters that suit a given hardware cache best
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <vector>
+
+#include "meshbuffer.h"
+#include "vcache.h"
+
+namespace sp
+{
+    struct TuneOptions
+    {
+        TuneOptions();
+
+        CacheModel model;           // cache the results are measured with
+        unsigned int cache_size;    // entries of that cache, up to analyzer::MaxCacheSize
+        unsigned int threads;       // 0 uses every core
+        unsigned int rounds;        // most search steps
+    };
+
+    struct TuneResult
+    {
+        VcacheParams params;
+        float acmr;                 // over all triangles of the corpus
+        float default_acmr;         // with VcacheParams(), 0 if those failed
+        unsigned int evaluations;   // parameter sets tried
+    };
+
+    // Pattern search from the defaults, or from the optimizer modeling the
+    // target's cache model and size if that does better. Every round tries
+    // each parameter a step up and a step down, moves to the best of those
+    // if it beats the current set, and halves the steps if none does. Every
+    // parameter set is run over the whole corpus, with the (set, mesh) pairs
+    // spread over the threads. The outcome doesn't depend on the thread count.
+    // Sets that can't be optimized on some mesh (out of memory, logged) are
+    // skipped, and evaluations is 0 when none of the starting sets could be.
+    TuneResult tuneParams(const std::vector<const MeshBuffer*>& corpus, const TuneOptions& options);
+}
+#endif // TUNE_H
@@ -1,315 +1,1211 @@
-#include <iostream>
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <string.h> // for memset
+#include <thread>
 
+#include "analyzer.h"
 #include "vcache.h"
 
 using namespace std;
 using namespace sp;
 
+namespace
+{
+    typedef chrono::high_resolution_clock Clock;
+
+    // smallest weight setParams keeps
+    const float MinParam = 0.01f;
+
+    double elapsedMs(Clock::time_point start)
+    {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+
+    bool testBit(const uint32_t* bits, int index)
+    {
+        return (bits[index >> 5] >> (index & 31)) & 1;
+    }
+
+    void setBit(uint32_t* bits, int index)
+    {
+        bits[index >> 5] |= 1u << (index & 31);
+    }
+
+    void clearBit(uint32_t* bits, int index)
+    {
+        bits[index >> 5] &= ~(1u << (index & 31));
+    }
+
+    // meshes smaller than this are set up on one thread, starting the
+    // others would take longer than the setup
+    const int MinParallelTris = 65536;
+
+    template <typename Task>
+    void runSlice(Task* task, int slice, int first, int last)
+    {
+        (*task)(slice, first, last);
+    }
+
+    // task(slice, first, last) for threads even slices of [0, count), the
+    // calling thread does slice 0
+    template <typename Task>
+    void runSliced(Task& task, int count, int threads)
+    {
+        vector<thread> pool;
+        for (int t=1; t<threads; ++t) {
+            int first = (int)((long long)count * t / threads);
+            int last = (int)((long long)count * (t + 1) / threads);
+            pool.push_back(thread(runSlice<Task>, &task, t, first, last));
+        }
+        task(0, 0, (int)((long long)count / threads));
+        for (size_t i=0; i<pool.size(); ++i)
+            pool[i].join();
+    }
+
+    // The parallel setup, in the order optimize runs it. Valences are
+    // counted with atomics and every vertex gets its slice from a prefix
+    // sum over per thread totals. Filling the slices with atomic cursors
+    // leaves each one in whatever order the threads got there, so it is
+    // sorted afterwards, which gives the ascending triangle order of the
+    // serial fill for any thread count.
+    struct ClearVerts
+    {
+        float* scores;
+        int* cache_pos;
+
+        void operator()(int, int first, int last) const
+        {
+            for (int i=first; i<last; ++i) {
+                scores[i] = 0.0f;
+                cache_pos[i] = -1;
+            }
+        }
+    };
+
+    template <typename Index>
+    struct CountValences
+    {
+        const Index* indices;
+        atomic<int>* counts;
+
+        void operator()(int, int first, int last) const
+        {
+            for (int i=first; i<last; ++i)
+                counts[indices[i]].fetch_add(1, memory_order_relaxed);
+        }
+    };
+
+    struct SumValences
+    {
+        const atomic<int>* counts;
+        int* sums;
+
+        void operator()(int slice, int first, int last) const
+        {
+            int sum = 0;
+            for (int i=first; i<last; ++i)
+                sum += counts[i].load(memory_order_relaxed);
+            sums[slice] = sum;
+        }
+    };
+
+    // sums holds where each slice starts by now, counts become the cursors
+    struct PlaceSlices
+    {
+        const int* sums;
+        atomic<int>* counts;
+        int* offsets;
+        int* valences;
+
+        void operator()(int slice, int first, int last) const
+        {
+            int offset = sums[slice];
+            for (int i=first; i<last; ++i) {
+                int valence = counts[i].load(memory_order_relaxed);
+                offsets[i] = offset;
+                valences[i] = valence;
+                counts[i].store(offset, memory_order_relaxed);
+                offset += valence;
+            }
+        }
+    };
+
+    template <typename Index>
+    struct FillSlices
+    {
+        const Index* indices;
+        atomic<int>* cursors;
+        int* tris;
+
+        void operator()(int, int first, int last) const
+        {
+            for (int i=first; i<last; ++i)
+                tris[cursors[indices[i]].fetch_add(1, memory_order_relaxed)] = i / 3;
+        }
+    };
+
+    struct SortSlices
+    {
+        const int* offsets;
+        int* tris;
+
+        void operator()(int, int first, int last) const
+        {
+            for (int i=first; i<last; ++i)
+                sort(tris + offsets[i], tris + offsets[i + 1]);
+        }
+    };
+
+    template <typename Index>
+    struct CopyTris
+    {
+        const Index* indices;
+        float* scores;
+        int* verts;
+
+        void operator()(int, int first, int last) const
+        {
+            for (int i=first; i<last; ++i) {
+                scores[i] = 0.0f;
+                verts[i * 3 + 0] = indices[i * 3 + 0];
+                verts[i * 3 + 1] = indices[i * 3 + 1];
+                verts[i * 3 + 2] = indices[i * 3 + 2];
+            }
+        }
+    };
+
+    // adds delta[k] to every entry at or past last[k], for four spans at a
+    // time so the loop stays branch free
+    void shiftTris(int* tris, int count, const int* last, const int* delta)
+    {
+        for (int i=0; i<count; ++i) {
+            int tri = tris[i];
+            tris[i] = tri + (tri >= last[0] ? delta[0] : 0) + (tri >= last[1] ? delta[1] : 0)
+                          + (tri >= last[2] ? delta[2] : 0) + (tri >= last[3] ? delta[3] : 0);
+        }
+    }
+
+    // triangles removed closer than this in the order are optimized again
+    // as one span. further apart they are mostly the optimizer passing the
+    // same spot again a band later, and each pass gets a span of its own.
+    const int SpanGap = 1024;
+
+    // a stretch of the order update optimizes again
+    struct EditSpan
+    {
+        int first;                      // [first, last) of the order before the update
+        int last;
+        vector<unsigned int> added;     // new triangles that go in with it
+        vector<unsigned int> result;    // the span optimized again
+    };
+}
+
+// the counters slow the loop down by about a fifth, so they are left out
+// unless asked for
+#ifdef SP_VCACHE_STATS
+#define SP_COUNT(counter, n) (Stats.counter += (n))
+#define SP_TIMED(counter, expr) do { Clock::time_point start_ = Clock::now(); expr; Stats.counter += elapsedMs(start_); } while (0)
+#else
+#define SP_COUNT(counter, n) ((void)0)
+#define SP_TIMED(counter, expr) do { expr; } while (0)
+#endif
+
+string sp::statsReport(const OptimizeStats& stats, const PhaseTimes& times)
+{
+    char report[1024];
+    snprintf(report, sizeof(report),
+             "{\"init_ms\": %.3f, \"score_ms\": %.3f, \"loop_ms\": %.3f, \"steps\": %llu, "
+             "\"tris_scored\": %llu, \"dead_ends\": %llu, \"dead_end_ms\": %.3f, "
+             "\"tree_updates\": %llu, \"tree_rebuilds\": %llu, \"adj_scanned\": %llu, "
+             "\"adj_removed\": %llu, \"vertex_rescores\": %llu}",
+             times.init_ms, times.score_ms, times.loop_ms, stats.steps, stats.tris_scored,
+             stats.dead_ends, stats.dead_end_ms, stats.tree_updates, stats.tree_rebuilds,
+             stats.adj_scanned, stats.adj_removed, stats.vertex_rescores);
+    return report;
+}
+
+VcacheParams::VcacheParams()
+    : cache_decay_power(1.5f)
+    , last_tri_score(0.75f)
+    , valence_boost_scale(2.0f)
+    , valence_boost_power(0.5f)
+    , max_size_cache(35)
+    , cache_model(LruModel)
+{
+}
+
 vcache::vcache()
-    : CacheDecayPower(1.5f)
-    , LastTriScore(0.75f)
-    , ValenceBoostScale(2.0f)
-    , ValenceBoostPower(0.5f)
-    , MaxSizeCache(35)
+    : Progress(0)
+    , ProgressUser(0)
+    , Threads(1)
+    , VertCount(0)
+    , VertScores(0)
+    , VertCachePos(0)
+    , VertTrisLeft(0)
+    , TriCount(0)
+    , TriScores(0)
+    , TriVerts(0)
+    , TriAdded(0)
+    , TriDirty(0)
+    , AdjOffsets(0)
+    , AdjTris(0)
+    , BestLeaves(0)
+    , BestTris(0)
+    , DirtyTris(0)
+    , DirtyCount(0)
+    , NewTriangleList(0)
+    , NewIndexCount(0)
+    , Edited(false)
 {
+    setParams(VcacheParams());
+    reset();
+}
+
+void vcache::setParams(const VcacheParams& params)
+{
+    // a score of 0 for every vert would leave nothing to pick, so the
+    // weights stay positive
+    CacheDecayPower = max(params.cache_decay_power, MinParam);
+    LastTriScore = max(params.last_tri_score, MinParam);
+    ValenceBoostScale = max(params.valence_boost_scale, MinParam);
+    ValenceBoostPower = max(params.valence_boost_power, MinParam);
+
+    // the three verts of the last triangle always fit
+    MaxSizeCache = params.max_size_cache;
+    if (MaxSizeCache < 4) MaxSizeCache = 4;
+    if (MaxSizeCache > CacheCapacity + 3) MaxSizeCache = CacheCapacity + 3;
+
+    Model = params.cache_model;
+    _init_score_tables();
+}
+
+VcacheParams vcache::getParams() const
+{
+    VcacheParams params;
+    params.cache_decay_power = CacheDecayPower;
+    params.last_tri_score = LastTriScore;
+    params.valence_boost_scale = ValenceBoostScale;
+    params.valence_boost_power = ValenceBoostPower;
+    params.max_size_cache = MaxSizeCache;
+    params.cache_model = Model;
+    return params;
+}
+
+void vcache::setProgressCallback(ProgressCallback callback, void* user)
+{
+    Progress = callback;
+    ProgressUser = user;
+}
+
+void vcache::setThreads(unsigned int threads)
+{
+    Threads = threads;
+}
+
+int vcache::_setup_threads(int tri_count) const
+{
+    if (tri_count < MinParallelTris) return 1;
+
+    int threads = Threads;
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    return threads;
 }
 
 void vcache::optimize(const MeshBuffer& buffer)
 {
-    // start init'ing
-    cout << "[ ] Initializing verts" << endl;
-    _init_verts(buffer);
+    logMessage(LogInfo, "Optimizing %u verts, %u triangles", buffer.getVertCnt(), buffer.getIdxCnt() / 3);
+    optimize(buffer.getIndexData(), buffer.getIdxCnt(), buffer.getVertCnt());
+}
 
-    cout << "[ ] Initializing triangles" << endl;
-    _init_tris(buffer);
+void vcache::optimize(const uint32_t* indices, unsigned int idx_cnt, unsigned int vert_cnt)
+{
+    _optimize(indices, idx_cnt, vert_cnt);
+}
 
-    // get the scores going
-    cout << "[ ] Initializing scores" << endl;
-    _init_scores();
+void vcache::optimize(const uint16_t* indices, unsigned int idx_cnt, unsigned int vert_cnt)
+{
+    _optimize(indices, idx_cnt, vert_cnt);
+}
 
-    cout << "[ ] Verts: " << buffer.getVertCnt() << " Triangles: " << buffer.getIdxCnt() / 3 << endl;
+void vcache::optimizeInPlace(uint32_t* indices, unsigned int idx_cnt, unsigned int vert_cnt)
+{
+    _optimize(indices, idx_cnt, vert_cnt);
+    copyIndices(indices);
+}
 
-    cout << "[ ] Optimizing..." << endl;
-    while (true) {
-        int next_tri = _find_next_tri();
-        if (next_tri < 0) break;
-        _add_tri_to_LRU(next_tri);
-    }
-    cout << "[!] Optimizing finised" << endl;
+void vcache::optimizeInPlace(uint16_t* indices, unsigned int idx_cnt, unsigned int vert_cnt)
+{
+    _optimize(indices, idx_cnt, vert_cnt);
+    copyIndices(indices);
 }
 
-void vcache::test_result(const MeshBuffer& buffer)
+bool vcache::update(const unsigned int* removed, unsigned int removed_count,
+                    const unsigned int* added, unsigned int added_idx_cnt, unsigned int vert_cnt)
 {
-    cout << "[ ] Comparing results between the optimized mesh and non optimized mesh.\n"
-         << "[-] This will report the ACMR's for the before and after, the lower the better"
-         << endl;
+    int tri_count = NewIndexCount / 3;
+    if (!AdjOffsets) {
+        logMessage(LogError, "Nothing to update, optimize a mesh first");
+        return false;
+    }
+    if (added_idx_cnt % 3 != 0) {
+        logMessage(LogError, "Added %u indices, not whole triangles", added_idx_cnt);
+        return false;
+    }
+    for (unsigned int i=0; i<added_idx_cnt; ++i) {
+        if (added[i] >= vert_cnt) {
+            logMessage(LogError, "Added index %u is past %u verts", added[i], vert_cnt);
+            return false;
+        }
+    }
 
-    int non_opt_misses = 0;
-    int opt_misses = 0;
-    bool found = false;
-    std::deque<int> fifo;
+    vector<int> gone(removed, removed + removed_count);
+    sort(gone.begin(), gone.end());
+    for (size_t i=0; i<gone.size(); ++i) {
+        if (gone[i] < 0 || gone[i] >= tri_count || (i > 0 && gone[i] == gone[i - 1])) {
+            logMessage(LogError, "Can't remove triangle %d of %d", gone[i], tri_count);
+            return false;
+        }
+    }
 
-    // first the non optimized mesh
-    const unsigned int *indices = buffer.getIndices();
-    for (int i=0; i<buffer.getIdxCnt(); ++i) {
-        found = false;
+    // where in the order the edit lands: the triangles removed, or the
+    // ones next to the added ones when nothing goes
+    vector<int> anchors(gone);
+    if (anchors.empty()) {
+        for (unsigned int i=0; i<added_idx_cnt; ++i)
+            _adjacent(added[i], anchors);
+        sort(anchors.begin(), anchors.end());
+        anchors.erase(unique(anchors.begin(), anchors.end()), anchors.end());
+    }
 
-        int vert_idx = indices[i];
-        for (int j=0; j<fifo.size(); ++j) {
-            if (vert_idx == fifo[j]) {
-                found = true;
-                break;
-            }
+    // anchors close together share a span, added triangles touching
+    // nothing at all go to the end
+    vector<EditSpan> spans;
+    vector<int> firsts;
+    for (size_t i=0; i<anchors.size(); ++i) {
+        if (spans.empty() || anchors[i] - spans.back().last >= SpanGap) {
+            spans.push_back(EditSpan());
+            spans.back().first = anchors[i];
+            firsts.push_back(anchors[i]);
         }
+        spans.back().last = anchors[i] + 1;
+    }
+    if (spans.empty()) {
+        spans.push_back(EditSpan());
+        spans.back().first = spans.back().last = tri_count;
+        firsts.push_back(tri_count);
+    }
 
-        // if not found keep track, and add it to the deque
-        if (found == false) {
-            non_opt_misses++;
-            fifo.push_back(vert_idx);
+    // every added triangle joins the span most of its neighbours are in,
+    // or the one closest to them
+    vector<int> near;
+    vector<int> votes(spans.size(), 0);
+    vector<size_t> voted;
+    for (unsigned int i=0; i<added_idx_cnt; i+=3) {
+        near.clear();
+        for (int k=0; k<3; ++k)
+            _adjacent(added[i + k], near);
+
+        size_t best = spans.size() - 1;
+        int best_dist = INT_MAX;
+        for (size_t j=0; j<near.size(); ++j) {
+            int tri = near[j];
+            size_t next = upper_bound(firsts.begin(), firsts.end(), tri) - firsts.begin();
+            if (next > 0 && tri < spans[next - 1].last) {
+                if (votes[next - 1]++ == 0) voted.push_back(next - 1);
+                continue;
+            }
+            if (next > 0 && tri + 1 - spans[next - 1].last < best_dist) {
+                best = next - 1;
+                best_dist = tri + 1 - spans[next - 1].last;
+            }
+            if (next < spans.size() && spans[next].first - tri < best_dist) {
+                best = next;
+                best_dist = spans[next].first - tri;
+            }
+        }
 
-            // be sure to keep the size contained
-            int difference = (int)fifo.size() - (MaxSizeCache-3);
-            for (int i=0; i<difference; ++i)
-                fifo.pop_front();
+        int best_votes = 0;
+        for (size_t j=0; j<voted.size(); ++j) {
+            size_t span = voted[j];
+            if (votes[span] > best_votes || (votes[span] == best_votes && span < best)) {
+                best = span;
+                best_votes = votes[span];
+            }
+            votes[span] = 0;
         }
+        voted.clear();
+        spans[best].added.insert(spans[best].added.end(), added + i, added + i + 3);
     }
 
-    // and now the optimized one
-    for (int i=0; i<(int)NewTriangleList.size(); ++i) {
-        found = false;
+    // the arena list can't grow
+    if (!Edited) {
+        EditedList.assign(NewTriangleList, NewTriangleList + NewIndexCount);
+        Edited = true;
+    }
 
-        int vert_idx = NewTriangleList[i];
-        for (int j=0; j<fifo.size(); ++j) {
-            if (vert_idx == fifo[j]) {
-                found = true;
-                break;
+    vcache optimizer;
+    optimizer.setParams(getParams());
+    vector<unsigned int> local;
+    vector<unsigned int> verts;
+
+    for (size_t s=0; s<spans.size(); ++s) {
+        EditSpan& span = spans[s];
+
+        // give the span its own dense vertex range
+        local.clear();
+        verts.clear();
+        vector<int>::const_iterator next_gone = lower_bound(gone.begin(), gone.end(), span.first);
+        for (int i=span.first; i<span.last; ++i) {
+            if (next_gone != gone.end() && *next_gone == i) {
+                ++next_gone;
+                continue;
             }
+            for (int k=0; k<3; ++k)
+                local.push_back(_local_vert(EditedList[i * 3 + k], verts));
+        }
+        for (size_t i=0; i<span.added.size(); ++i)
+            local.push_back(_local_vert(span.added[i], verts));
+        for (size_t i=0; i<verts.size(); ++i)
+            LocalVerts[verts[i]] = -1;
+
+        span.result.clear();
+        if (!local.empty()) {
+            // out of memory, logged by optimize. nothing has changed yet
+            optimizer.optimize(&local[0], (unsigned int)local.size(), (unsigned int)verts.size());
+            if (optimizer.getIndexCount() != local.size()) return false;
+
+            const unsigned int* order = optimizer.getIndices();
+            for (unsigned int i=0; i<optimizer.getIndexCount(); ++i)
+                span.result.push_back(verts[order[i]]);
         }
+    }
+
+    for (size_t s=0; s<spans.size(); ++s) {
+        const EditSpan& span = spans[s];
+        for (int i=span.first; i<span.last; ++i)
+            for (int k=0; k<3; ++k)
+                _remove_adjacent(EditedList[i * 3 + k], i);
+    }
+
+    // everything behind a span moves by what the span grew. four spans a
+    // pass, back to front, each pass also catches what the ones before
+    // it moved
+    vector<int> lasts;
+    vector<int> deltas;
+    for (size_t s=0; s<spans.size(); ++s) {
+        int delta = (int)spans[s].result.size() / 3 - (spans[s].last - spans[s].first);
+        if (delta == 0) continue;
+        lasts.push_back(spans[s].last);
+        deltas.push_back(delta);
+    }
+    while (lasts.size() % 4) {
+        lasts.push_back(INT_MAX);
+        deltas.push_back(0);
+    }
+    for (size_t g=lasts.size(); g>0; g-=4) {
+        shiftTris(AdjTris, AdjOffsets[VertCount], &lasts[g - 4], &deltas[g - 4]);
+        for (size_t i=0; i<ExtraAdj.size(); ++i)
+            shiftTris(&ExtraAdj[i].second, 1, &lasts[g - 4], &deltas[g - 4]);
+    }
 
-        // if not found keep track, and add it to the deque
-        if (found == false) {
-            opt_misses++;
-            fifo.push_back(vert_idx);
+    // the triangles between and after the spans move in one go. the
+    // stretches moving back go front to back and the others back to
+    // front, neither overwrites what the other has yet to read
+    vector<int> moved(spans.size());
+    int total = 0;
+    for (size_t s=0; s<spans.size(); ++s) {
+        total += (int)spans[s].result.size() / 3 - (spans[s].last - spans[s].first);
+        moved[s] = total;
+    }
+    if (total > 0)
+        EditedList.resize(EditedList.size() + total * 3);
+    for (size_t s=0; s<spans.size(); ++s) {
+        int end = s + 1 < spans.size() ? spans[s + 1].first : tri_count;
+        if (moved[s] < 0 && end > spans[s].last)
+            memmove(&EditedList[(spans[s].last + moved[s]) * 3], &EditedList[spans[s].last * 3],
+                    (end - spans[s].last) * 3 * sizeof(unsigned int));
+    }
+    for (size_t s=spans.size(); s-- > 0; ) {
+        int end = s + 1 < spans.size() ? spans[s + 1].first : tri_count;
+        if (moved[s] > 0 && end > spans[s].last)
+            memmove(&EditedList[(spans[s].last + moved[s]) * 3], &EditedList[spans[s].last * 3],
+                    (end - spans[s].last) * 3 * sizeof(unsigned int));
+    }
+    if (total < 0)
+        EditedList.resize(EditedList.size() + total * 3);
+
+    for (size_t s=0; s<spans.size(); ++s) {
+        const vector<unsigned int>& result = spans[s].result;
+        int first = spans[s].first + (s > 0 ? moved[s - 1] : 0);
+        for (size_t i=0; i<result.size(); ++i)
+            EditedList[first * 3 + i] = result[i];
+        for (int i=first; i<first+(int)result.size()/3; ++i)
+            for (int k=0; k<3; ++k)
+                _add_adjacent(EditedList[i * 3 + k], i);
+    }
+    sort(ExtraAdj.begin(), ExtraAdj.end());
+
+    NewIndexCount = (int)EditedList.size();
+    NewTriangleList = EditedList.empty() ? 0 : &EditedList[0];
+    TriCount = NewIndexCount / 3;
+
+    // the free slots ran out for too many entries, give every vertex
+    // a slice big enough again
+    if (ExtraAdj.size() > EditedList.size() / 16)
+        return _rebuild_adjacency(max(VertCount, ExtraAdj.back().first + 1));
+    return true;
+}
+
+template <typename Index>
+void vcache::_optimize(const Index* indices, unsigned int idx_cnt, unsigned int vert_cnt)
+{
+    reset();
+
+    // start init'ing
+    Clock::time_point start = Clock::now();
+    if (!_init_verts(indices, idx_cnt, vert_cnt) || !_init_tris(indices, idx_cnt)) {
+        logMessage(LogError, "Out of memory optimizing %u verts, %u triangles", vert_cnt, idx_cnt / 3);
+        reset();
+        return;
+    }
+    Times.init_ms = elapsedMs(start);
+
+    // get the scores going
+    start = Clock::now();
+    _init_scores();
+    Times.score_ms = elapsedMs(start);
+
+    start = Clock::now();
+    if (Model == FifoModel) {
+        FifoCache<CacheCapacity> cache;
+        _run(cache);
+    }
+    else if (Model == BatchModel) {
+        BatchCache<CacheCapacity> cache;
+        _run(cache);
+    }
+    else {
+        LruCache<CacheCapacity> cache;
+        _run(cache);
+    }
+    Times.loop_ms = elapsedMs(start);
+
+    if (Progress) Progress(1.0f, ProgressUser);
+}
+
+template <typename Cache>
+void vcache::_run(Cache& cache)
+{
+    cache.setLimit(MaxSizeCache - 3);
+
+    // no more than 64 reports, and none at all for small meshes
+    int report_step = TriCount / 64;
+    if (report_step < 4096) report_step = 4096;
+    int next_report = report_step;
+
+    while (true) {
+        int next_tri = _find_next_tri(cache);
+        if (next_tri < 0) break;
+        _add_tri_to_cache(cache, next_tri);
 
-            // be sure to keep the size contained
-            int difference = (int)fifo.size() - (MaxSizeCache-3);
-            for (int i=0; i<difference; ++i)
-                fifo.pop_front();
+        if (Progress && NewIndexCount >= next_report * 3) {
+            Progress((float)NewIndexCount / (TriCount * 3), ProgressUser);
+            next_report += report_step;
         }
     }
+}
 
-    const float triangle_count = (float)Tris.size();
-    float opt_acmr = opt_misses / triangle_count;
-    float non_opt_acmr = non_opt_misses / triangle_count;
-    cout << "[!] Optimized ACMR: " << opt_acmr << " Non: " << non_opt_acmr << endl;
+void vcache::reset()
+{
+    // everything of the last mesh lives in the arena, which keeps its
+    // memory for the next one
+    Scratch.reset();
+    VertCount = 0;
+    VertScores = 0;
+    VertCachePos = 0;
+    VertTrisLeft = 0;
+    TriCount = 0;
+    TriScores = 0;
+    TriVerts = 0;
+    TriAdded = 0;
+    TriDirty = 0;
+    AdjOffsets = 0;
+    AdjTris = 0;
+    BestLeaves = 0;
+    BestTris = 0;
+    DirtyTris = 0;
+    DirtyCount = 0;
+    NewTriangleList = 0;
+    NewIndexCount = 0;
+    ExtraAdj.clear();
+    EditedList.clear();
+    Edited = false;
+    Times.init_ms = 0.0;
+    Times.score_ms = 0.0;
+    Times.loop_ms = 0.0;
+    memset(&Stats, 0, sizeof(Stats));
+}
+
+void vcache::release()
+{
+    reset();
+    Scratch.release();
+    vector<pair<int, int> >().swap(ExtraAdj);
+    vector<unsigned int>().swap(EditedList);
+    vector<int>().swap(LocalVerts);
+}
+
+void vcache::test_result(const MeshBuffer& buffer)
+{
+    // every analyze starts from an empty cache
+    analyzer stats;
+    unsigned int size = MaxSizeCache - 3;
+    stats.setCacheSizes(&size, 1);
+
+    stats.analyze(buffer.getIndexData(), buffer.getIdxCnt(), buffer.getVertCnt());
+    float non_opt_acmr = stats.getStats(Model, 0).acmr;
+
+    stats.analyze(getIndices(), getIndexCount(), buffer.getVertCnt());
+    float opt_acmr = stats.getStats(Model, 0).acmr;
+
+    logMessage(LogInfo, "Optimized ACMR: %g Non: %g", opt_acmr, non_opt_acmr);
+}
+
+const PhaseTimes& vcache::getPhaseTimes() const
+{
+    return Times;
+}
+
+bool vcache::statsEnabled()
+{
+#ifdef SP_VCACHE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+const OptimizeStats& vcache::getStats() const
+{
+    return Stats;
 }
 
 unsigned int vcache::getIndexCount() const
 {
-    return NewTriangleList.size();
+    return NewIndexCount;
 }
 
 const unsigned int * vcache::getIndices() const
 {
-    return &NewTriangleList[0];
+    return NewTriangleList;
+}
+
+const int * vcache::getAdjacencyOffsets() const
+{
+    return AdjOffsets;
+}
+
+const int * vcache::getAdjacencyTris() const
+{
+    return AdjTris;
+}
+
+void vcache::_init_score_tables()
+{
+    assert( MaxSizeCache - 3 <= CacheCapacity );
+    for (int i=0; i<CacheCapacity; ++i) {
+        if (i < 3) {
+            // this triangle was used in the last triangle,
+            // so it has a fixed score, which ever of the three its in.
+            // Otherwise, you can get very different answers
+            // depending on whether you add the triangle
+            // 1,2,3 or 3,1,2 - which is silly.
+            CacheScores[i] = LastTriScore;
+        }
+        else if (i < MaxSizeCache - 3) {
+            const float scalar = 1.0f / (MaxSizeCache - 3);
+            float score = 1.0f - (i - 3) * scalar;
+            CacheScores[i] = powf(score, CacheDecayPower);
+        }
+        else {
+            // past the end of the cache, never looked up
+            CacheScores[i] = 0.0f;
+        }
+    }
+
+    // no triangles left is handled in _score_vertex
+    ValenceScores[0] = 0.0f;
+    for (int i=1; i<ValenceTableSize; ++i)
+        ValenceScores[i] = ValenceBoostScale * powf((float)i, -ValenceBoostPower);
 }
 
 void vcache::_init_scores()
 {
-    for (int i=0; i<(int)Verts.size(); ++i)
+    for (int i=0; i<VertCount; ++i)
         _score_vertex(i);
 
-    for (int i=0; i<(int)Tris.size(); ++i)
+    for (int i=0; i<TriCount; ++i)
         _score_triangle(i);
+
+    _init_best_tris();
 }
 
-void vcache::_init_verts(const MeshBuffer& buffer)
+template <typename Index>
+bool vcache::_init_verts(const Index* indices, unsigned int idx_cnt, unsigned int vert_cnt)
 {
     /***************************************
       Find valence counts for all verts
       Make a list to the triangles using them
       init cache positions to -1 (-1 means not added yet)
     ***************************************/
-    int size = buffer.getVertCnt();
-    Verts.reserve(size);
+    int size = vert_cnt;
+    VertCount = size;
+    VertScores = Scratch.alloc<float>(size);
+    VertCachePos = Scratch.alloc<int>(size);
+    VertTrisLeft = Scratch.alloc<int>(size);
+    AdjOffsets = Scratch.alloc<int>(size + 1);
+    AdjTris = Scratch.alloc<int>(idx_cnt);
+    if (!VertScores || !VertCachePos || !VertTrisLeft || !AdjOffsets || !AdjTris)
+        return false;
+
+    int threads = _setup_threads(idx_cnt / 3);
+    if (threads > 1) {
+        _init_verts_parallel(indices, idx_cnt, threads);
+        return true;
+    }
+
     for (int i=0; i<size; ++i) {
-        Vertex vert;
-        vert.cache_pos = -1;
-        vert.maxValence = 0;
-        vert.score = 0;
-        vert.trisNotAdded = 0;
-        Verts.push_back(vert);
+        VertScores[i] = 0.0f;
+        VertCachePos[i] = -1;
+        VertTrisLeft[i] = 0;
     }
 
-    const unsigned int *indices = buffer.getIndices();
-    for (int i=0; i<buffer.getIdxCnt(); ++i) {
+    // first pass counts the valences so every vertex gets its slice
+    AdjOffsets[0] = 0;
+    for (int i=0; i<(int)idx_cnt; ++i) {
         int vert_idx = indices[i];
-        Verts[vert_idx].maxValence++;
-        Verts[vert_idx].trisNotAdded++;
-        Verts[vert_idx].reference_list.push_back( i / 3 );
+        VertTrisLeft[vert_idx]++;
+    }
+
+    for (int i=0; i<size; ++i) {
+        AdjOffsets[i + 1] = AdjOffsets[i] + VertTrisLeft[i];
+        VertTrisLeft[i] = 0;
+    }
+
+    // second pass fills the slices, VertTrisLeft doubles as the write cursor
+    for (int i=0; i<(int)idx_cnt; ++i) {
+        int vert_idx = indices[i];
+        AdjTris[AdjOffsets[vert_idx] + VertTrisLeft[vert_idx]] = i / 3;
+        VertTrisLeft[vert_idx]++;
     }
 
     /*
     int average_valence = 0;
-    for (int i=0; i<(int)Verts.size(); ++i) {
-        average_valence += Verts[i].maxValence;
+    for (int i=0; i<VertCount; ++i) {
+        average_valence += AdjOffsets[i + 1] - AdjOffsets[i];
     }
-    average_valence /= Verts.size();
+    average_valence /= VertCount;
     cout << "[ ] average valence: " << average_valence << endl;
     */
+    return true;
 }
 
-void vcache::_init_tris(const MeshBuffer& buffer)
+template <typename Index>
+void vcache::_init_verts_parallel(const Index* indices, unsigned int idx_cnt, int threads)
 {
-    const unsigned int *indices = buffer.getIndices();
+    // the arena only holds plain data, the counters are the setup's own.
+    // a vector of atomics can't grow, so it isn't kept for the next mesh
+    int size = VertCount;
+    vector<atomic<int> > count_list(size);
+    atomic<int>* counts = &count_list[0];
+    ClearVerts clear = { VertScores, VertCachePos };
+    runSliced(clear, size, threads);
 
-    int size = buffer.getIdxCnt() / 3;
-    Tris.reserve(size);
-    for (int i=0; i<size; ++i) {
-        Triangle tri;
-        tri.in_cache = false;
-        tri.score = 0.0f;
-        tri.referenced_verts[0] = indices[i * 3 + 0];
-        tri.referenced_verts[1] = indices[i * 3 + 1];
-        tri.referenced_verts[2] = indices[i * 3 + 2];
-        Tris.push_back(tri);
+    CountValences<Index> count = { indices, counts };
+    runSliced(count, idx_cnt, threads);
+
+    vector<int> sums(threads);
+    SumValences sum = { counts, &sums[0] };
+    runSliced(sum, size, threads);
+    int offset = 0;
+    for (int t=0; t<threads; ++t) {
+        int slice = sums[t];
+        sums[t] = offset;
+        offset += slice;
     }
 
-    NewTriangleList.reserve(buffer.getIdxCnt());
+    AdjOffsets[size] = idx_cnt;
+    PlaceSlices place = { &sums[0], counts, AdjOffsets, VertTrisLeft };
+    runSliced(place, size, threads);
+
+    FillSlices<Index> fill = { indices, counts, AdjTris };
+    runSliced(fill, idx_cnt, threads);
+
+    SortSlices order = { AdjOffsets, AdjTris };
+    runSliced(order, size, threads);
 }
 
-void vcache::_score_vertex(int index)
+template <typename Index>
+bool vcache::_init_tris(const Index* indices, unsigned int idx_cnt)
 {
-    if (Verts[index].trisNotAdded == 0) {
-        Verts[index].score = -1.0;
-        return;
-    }
+    int size = idx_cnt / 3;
+    int words = (size + 31) / 32;
+    TriCount = size;
+    TriScores = Scratch.alloc<float>(size);
+    TriVerts = Scratch.alloc<int>(size * 3);
+    TriAdded = Scratch.alloc<uint32_t>(words);
+    TriDirty = Scratch.alloc<uint32_t>(words);
+    // a triangle is never on the dirty list twice
+    DirtyTris = Scratch.alloc<int>(size);
+    NewTriangleList = Scratch.alloc<unsigned int>(size * 3);
 
-    float score = 0.0f;
-    int cache_pos = Verts[index].cache_pos;
-    if (cache_pos < 0) {
-        // not in cache, so no score
+    // the tournament tree is rebuilt more than once per mesh, its size
+    // never changes
+    BestLeaves = 1;
+    while (BestLeaves < size)
+        BestLeaves <<= 1;
+    BestTris = Scratch.alloc<int>(BestLeaves * 2);
+
+    if (!TriScores || !TriVerts || !TriAdded || !TriDirty || !DirtyTris || !NewTriangleList || !BestTris)
+        return false;
+
+    int threads = _setup_threads(size);
+    if (threads > 1) {
+        CopyTris<Index> copy = { indices, TriScores, TriVerts };
+        runSliced(copy, size, threads);
     }
     else {
-        if (cache_pos < 3) {
-            // this triangle was used in the last triangle,
-            // so it has a fixed score, which ever of the three its in.
-            // Otherwise, you can get very different answers
-            // depending on whether you add the triangle
-            // 1,2,3 or 3,1,2 - which is silly.
-            score = LastTriScore;
-        }
-        else {
-            assert( cache_pos < MaxSizeCache );
-            const float scalar = 1.0f / (MaxSizeCache - 3);
-            score = 1.0f - (cache_pos - 3) * scalar;
-            score = powf(score, CacheDecayPower);
+        for (int i=0; i<size; ++i) {
+            TriScores[i] = 0.0f;
+            TriVerts[i * 3 + 0] = indices[i * 3 + 0];
+            TriVerts[i * 3 + 1] = indices[i * 3 + 1];
+            TriVerts[i * 3 + 2] = indices[i * 3 + 2];
         }
     }
 
-    float valenceBoost = powf(Verts[index].trisNotAdded, -ValenceBoostPower);
-    score = ValenceBoostScale * valenceBoost;
-    Verts[index].score = score;
+    memset(TriAdded, 0, words * sizeof(uint32_t));
+    memset(TriDirty, 0, words * sizeof(uint32_t));
+    return true;
 }
 
-void vcache::_score_triangle(int index)
+void vcache::_score_vertex(int index)
 {
-    float score = 0;
-    int idx;
+    SP_COUNT(vertex_rescores, 1);
+    int tris_left = VertTrisLeft[index];
+    if (tris_left == 0) {
+        VertScores[index] = -1.0;
+        return;
+    }
 
-    idx = Tris[index].referenced_verts[0];
-    score += Verts[idx].score;
+    // not in cache, so no score
+    float score = 0.0f;
+    int cache_pos = VertCachePos[index];
+    if (cache_pos >= 0) {
+        assert( cache_pos < MaxSizeCache - 3 );
+        score = CacheScores[cache_pos];
+    }
 
-    idx = Tris[index].referenced_verts[1];
-    score += Verts[idx].score;
+    if (tris_left < ValenceTableSize)
+        score += ValenceScores[tris_left];
+    else
+        score += ValenceBoostScale * powf((float)tris_left, -ValenceBoostPower);
+    VertScores[index] = score;
+}
 
-    idx = Tris[index].referenced_verts[2];
-    score += Verts[idx].score;
+void vcache::_score_triangle(int index)
+{
+    const int* verts = &TriVerts[index * 3];
+    float score = 0;
+    score += VertScores[verts[0]];
+    score += VertScores[verts[1]];
+    score += VertScores[verts[2]];
 
-    Tris[index].score = score;
+    if (TriScores[index] != score && !testBit(TriDirty, index)) {
+        setBit(TriDirty, index);
+        DirtyTris[DirtyCount++] = index;
+    }
+    TriScores[index] = score;
 }
 
-int  vcache::_find_next_tri()
+template <typename Cache>
+int  vcache::_find_next_tri(const Cache& cache)
 {
     float highest_score = 0.0f;
     int   highest_index = -1;
+    SP_COUNT(steps, 1);
+
     // try searching through the verts that are in the cache to find a triangle
     // that has not been added yet.
-    for (int i=0; i<(int)LRU.size(); ++i) {
-        int vert_idx = LRU[i];
-        for (int j=0; j<(int)Verts[vert_idx].reference_list.size(); ++j) {
-            int tri_idx = Verts[vert_idx].reference_list[j];
-            if (Tris[tri_idx].in_cache) break;
+    for (int i=0; i<cache.size(); ++i) {
+        int vert_idx = cache[i];
+        const int *live = &AdjTris[AdjOffsets[vert_idx]];
+        SP_COUNT(tris_scored, VertTrisLeft[vert_idx]);
+        for (int j=0; j<VertTrisLeft[vert_idx]; ++j) {
+            int tri_idx = live[j];
 
             _score_triangle(tri_idx);
-            if (Tris[tri_idx].score > highest_score) {
-                highest_score = Tris[tri_idx].score;
+            if (TriScores[tri_idx] > highest_score) {
+                highest_score = TriScores[tri_idx];
                 highest_index = tri_idx;
             }
         }
     }
 
     if (highest_index == -1) {
-        // if the LRU cache is empty, or all of the referenced triangles
+        // if the cache is empty, or all of the referenced triangles
         // from the verts have already been in the cache
         // find the highest ranking triangle from all of them
-        for (int i=0; i<(int)Tris.size(); ++i) {
-            if (Tris[i].in_cache) continue;
-
-            if (Tris[i].score > highest_score) {
-                highest_score = Tris[i].score;
-                highest_index = i;
-            }
-        }
-
+        SP_COUNT(dead_ends, 1);
+        SP_TIMED(dead_end_ms, _flush_best_tris());
+        highest_index = BestTris[1];
     }
 
     return highest_index;
 }
 
-void vcache::_add_tri_to_LRU(int index)
+template <typename Cache>
+void vcache::_add_tri_to_cache(Cache& cache, int index)
 {
-    Tris[index].in_cache = true;
+    setBit(TriAdded, index);
+    if (!testBit(TriDirty, index)) {
+        setBit(TriDirty, index);
+        DirtyTris[DirtyCount++] = index;
+    }
 
-    NewTriangleList.push_back(Tris[index].referenced_verts[0]);
-    NewTriangleList.push_back(Tris[index].referenced_verts[1]);
-    NewTriangleList.push_back(Tris[index].referenced_verts[2]);
+    // the place of this triangle in the result, see AdjTris
+    int pos = NewIndexCount / 3;
+    const int* verts = &TriVerts[index * 3];
+    NewTriangleList[NewIndexCount++] = verts[0];
+    NewTriangleList[NewIndexCount++] = verts[1];
+    NewTriangleList[NewIndexCount++] = verts[2];
 
     int vert_idx;
     for (int i=0; i<3; ++i) {
-        vert_idx = Tris[index].referenced_verts[i];
-        Verts[vert_idx].trisNotAdded -= 1;
-        if (Verts[vert_idx].trisNotAdded < 0) {
-            cerr << "[!] Triangle: " << index << " Vert: " << vert_idx << " has valence less than zero!" << endl;
-            Verts[vert_idx].trisNotAdded = 0;
+        vert_idx = verts[i];
+        int last = VertTrisLeft[vert_idx] - 1;
+        if (last < 0) {
+            logMessage(LogError, "Triangle: %d Vert: %d has valence less than zero!", index, vert_idx);
         }
-
-        // now that this triangle has been added to the cache,
-        // update the verts by moving the reference to this triangle to the back
-        // of the list
-        std::vector<int>::iterator iter = Verts[vert_idx].reference_list.begin();
-        for (iter; iter!=Verts[vert_idx].reference_list.end(); ++iter ) {
-            int tri_idx = *(iter);
-            if (tri_idx == index) {
-                Verts[vert_idx].reference_list.erase(iter);
-                Verts[vert_idx].reference_list.push_back(tri_idx);
-                break;
+        else {
+            // now that this triangle has been added to the cache,
+            // swap it with the last live triangle of the vert and shrink
+            // the live range by one
+            int *live = &AdjTris[AdjOffsets[vert_idx]];
+            for (int j=0; j<=last; ++j) {
+                if (live[j] == index) {
+                    SP_COUNT(adj_scanned, j + 1);
+                    SP_COUNT(adj_removed, 1);
+                    live[j] = live[last];
+                    live[last] = pos;
+                    break;
+                }
             }
+            VertTrisLeft[vert_idx] = last;
         }
+    }
+
+    int evicted[CacheCapacity + 3];
+    int evicted_count;
+    int changed = cache.addTriangle(verts, evicted, evicted_count);
+
+    // verts pushed out are no longer in the cache
+    for (int i=0; i<evicted_count; ++i)
+        VertCachePos[evicted[i]] = -1;
 
-        LRU.push_front(vert_idx);
+    // only the front of the cache moved, everything behind it kept its
+    // position and its score
+    for (int i=0; i<changed; ++i) {
+        vert_idx = cache[i];
+        VertCachePos[vert_idx] = i;
+        _score_vertex(vert_idx);
     }
 
-    while (LRU.size() > (MaxSizeCache-3)) {
-        LRU.pop_back();
+    for (int i=0; i<evicted_count; ++i) {
+        if (VertCachePos[evicted[i]] < 0)
+            _score_vertex(evicted[i]);
     }
 
-    for (int i=0; i<(int)LRU.size(); ++i) {
-        // score verts
-        int vert_idx = LRU[i];
-        Verts[vert_idx].cache_pos = i;
-        _score_vertex(vert_idx);
+    // a FIFO or batch hit leaves the vertex where it was, but it has one
+    // triangle less to go
+    for (int i=0; i<3; ++i) {
+        vert_idx = verts[i];
+        if (VertCachePos[vert_idx] >= changed)
+            _score_vertex(vert_idx);
+    }
+}
+
+void vcache::_init_best_tris()
+{
+    /***************************************
+      Build the tournament tree bottom up.
+      Leaves are in triangle order so a node only
+      takes its right child when it scores strictly higher,
+      which keeps the lowest index on ties.
+    ***************************************/
+    SP_COUNT(tree_rebuilds, 1);
+    for (int i=0; i<BestLeaves * 2; ++i)
+        BestTris[i] = -1;
+    for (int i=0; i<TriCount; ++i)
+        BestTris[BestLeaves + i] = testBit(TriAdded, i) ? -1 : i;
+    memset(TriDirty, 0, (TriCount + 31) / 32 * sizeof(uint32_t));
+
+    for (int node=BestLeaves-1; node>0; --node) {
+        int left = BestTris[node * 2 + 0];
+        int right = BestTris[node * 2 + 1];
+        if (left < 0 || (right >= 0 && TriScores[right] > TriScores[left]))
+            BestTris[node] = right;
+        else
+            BestTris[node] = left;
+    }
+    DirtyCount = 0;
+}
+
+void vcache::_update_best_tri(int index)
+{
+    int node = BestLeaves + index;
+    BestTris[node] = testBit(TriAdded, index) ? -1 : index;
+
+    for (node >>= 1; node>0; node >>= 1) {
+        int left = BestTris[node * 2 + 0];
+        int right = BestTris[node * 2 + 1];
+        if (left < 0 || (right >= 0 && TriScores[right] > TriScores[left]))
+            BestTris[node] = right;
+        else
+            BestTris[node] = left;
+    }
+}
+
+void vcache::_flush_best_tris()
+{
+    // scores only change for triangles around the cache, so between dead ends
+    // there is usually a small batch to push up the tree. if most of the
+    // tree is dirty it is cheaper to just rebuild it.
+    int depth = 1;
+    while ((1 << depth) < BestLeaves)
+        depth++;
+
+    if (DirtyCount * depth > BestLeaves) {
+        _init_best_tris();
+        return;
+    }
+
+    SP_COUNT(tree_updates, DirtyCount);
+    for (int i=0; i<DirtyCount; ++i) {
+        int tri_idx = DirtyTris[i];
+        clearBit(TriDirty, tri_idx);
+        _update_best_tri(tri_idx);
+    }
+    DirtyCount = 0;
+}
+
+void vcache::_add_adjacent(int vert, int tri)
+{
+    if (vert < VertCount && VertTrisLeft[vert] > 0) {
+        VertTrisLeft[vert]--;
+        AdjTris[AdjOffsets[vert] + VertTrisLeft[vert]] = tri;
+    }
+    else {
+        // sorted again when the update is done
+        ExtraAdj.push_back(make_pair(vert, tri));
+    }
+}
+
+void vcache::_adjacent(int vert, vector<int>& tris) const
+{
+    if (vert < VertCount)
+        tris.insert(tris.end(), AdjTris + AdjOffsets[vert] + VertTrisLeft[vert], AdjTris + AdjOffsets[vert + 1]);
+
+    vector<pair<int, int> >::const_iterator it = lower_bound(ExtraAdj.begin(), ExtraAdj.end(), make_pair(vert, 0));
+    for (; it != ExtraAdj.end() && it->first == vert; ++it)
+        tris.push_back(it->second);
+}
+
+unsigned int vcache::_local_vert(unsigned int vert, vector<unsigned int>& verts)
+{
+    if (vert >= LocalVerts.size())
+        LocalVerts.resize(vert + 1, -1);
+    if (LocalVerts[vert] < 0) {
+        LocalVerts[vert] = (int)verts.size();
+        verts.push_back(vert);
     }
+    return LocalVerts[vert];
 }
 
+void vcache::_remove_adjacent(int vert, int tri)
+{
+    if (vert < VertCount) {
+        int* slice = &AdjTris[AdjOffsets[vert]];
+        int count = AdjOffsets[vert + 1] - AdjOffsets[vert];
+        for (int j=VertTrisLeft[vert]; j<count; ++j) {
+            if (slice[j] == tri) {
+                // its slot joins the free ones at the front
+                slice[j] = slice[VertTrisLeft[vert]];
+                VertTrisLeft[vert]++;
+                return;
+            }
+        }
+    }
+
+    vector<pair<int, int> >::iterator it = lower_bound(ExtraAdj.begin(), ExtraAdj.end(), make_pair(vert, tri));
+    assert( it != ExtraAdj.end() && *it == make_pair(vert, tri) );
+    ExtraAdj.erase(it);
+}
+
+bool vcache::_rebuild_adjacency(int vert_cnt)
+{
+    // only the adjacency is still needed once the list is edited, the
+    // rest of the arena goes with it
+    Scratch.reset();
+    VertScores = 0;
+    VertCachePos = 0;
+    TriScores = 0;
+    TriVerts = 0;
+    TriAdded = 0;
+    TriDirty = 0;
+    BestLeaves = 0;
+    BestTris = 0;
+    DirtyTris = 0;
+    DirtyCount = 0;
+    ExtraAdj.clear();
+
+    // same two passes as _init_verts, with places in the list
+    VertCount = vert_cnt;
+    VertTrisLeft = Scratch.alloc<int>(vert_cnt);
+    AdjOffsets = Scratch.alloc<int>(vert_cnt + 1);
+    AdjTris = Scratch.alloc<int>(NewIndexCount);
+    if (!VertTrisLeft || !AdjOffsets || !AdjTris) {
+        // the edit is done, but the next update has nothing to go on
+        logMessage(LogError, "Out of memory rebuilding the adjacency of %d verts", vert_cnt);
+        VertTrisLeft = 0;
+        AdjOffsets = 0;
+        AdjTris = 0;
+        return false;
+    }
+
+    for (int i=0; i<vert_cnt; ++i)
+        VertTrisLeft[i] = 0;
+    for (int i=0; i<NewIndexCount; ++i)
+        VertTrisLeft[NewTriangleList[i]]++;
+
+    AdjOffsets[0] = 0;
+    for (int i=0; i<vert_cnt; ++i) {
+        AdjOffsets[i + 1] = AdjOffsets[i] + VertTrisLeft[i];
+        VertTrisLeft[i] = 0;
+    }
+
+    for (int i=0; i<NewIndexCount; ++i) {
+        int vert_idx = NewTriangleList[i];
+        AdjTris[AdjOffsets[vert_idx] + VertTrisLeft[vert_idx]] = i / 3;
+        VertTrisLeft[vert_idx]++;
+    }
+
+    // no free slots
+    for (int i=0; i<vert_cnt; ++i)
+        VertTrisLeft[i] = 0;
+    return true;
+}
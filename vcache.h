@@ -1,13 +1,58 @@
 #ifndef VCACHE_H
 #define VCACHE_H
 
-#include <deque>
+#include <stdint.h>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "arena.h"
+#include "cachemodel.h"
+#include "log.h"
 #include "meshbuffer.h"
 
 namespace sp // Simple and to the Point
 {
+    // the knobs of the scoring, the defaults are the ones from the paper
+    struct VcacheParams
+    {
+        VcacheParams();
+
+        float cache_decay_power;    // how fast the score falls off deeper in the cache
+        float last_tri_score;       // score of the verts of the last triangle added
+        float valence_boost_scale;  // pull of verts with few triangles left
+        float valence_boost_power;
+        int max_size_cache;         // the cache modeled holds max_size_cache - 3 verts
+        CacheModel cache_model;     // how that cache behaves
+    };
+
+    // wall time of each step of the last optimize
+    struct PhaseTimes
+    {
+        double init_ms;             // _init_verts and _init_tris, the adjacency
+        double score_ms;            // first scores and the best triangle tree
+        double loop_ms;             // picking the triangles
+    };
+
+    // What the last optimize spent its time on. Only counted when built
+    // with SP_VCACHE_STATS (make STATS=1), otherwise the counting compiles
+    // to nothing and everything stays 0.
+    struct OptimizeStats
+    {
+        unsigned long long steps;           // _find_next_tri calls
+        unsigned long long tris_scored;     // candidates around the cache
+        unsigned long long dead_ends;       // no candidate, the best triangle tree was asked
+        double dead_end_ms;                 // flushing and asking that tree
+        unsigned long long tree_updates;    // dirty triangles pushed up the tree
+        unsigned long long tree_rebuilds;
+        unsigned long long adj_scanned;     // adjacency entries looked at to find the triangle added
+        unsigned long long adj_removed;     // entries moved out of the live range
+        unsigned long long vertex_rescores;
+    };
+
+    // one JSON object with the counters and the phase times
+    std::string statsReport(const OptimizeStats& stats, const PhaseTimes& times);
+
     // implements: 
     // http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html
     // https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
@@ -16,49 +61,179 @@ namespace sp // Simple and to the Point
     public:
         vcache();
 
+        // rebuilds the score tables, max_size_cache is clamped to what the
+        // cache can hold and the other values to at least 0.01
+        void setParams(const VcacheParams& params);
+        VcacheParams getParams() const;
+
+        // called every 1/64th of the triangles and once more at the end,
+        // on the thread running optimize. null turns it off again.
+        void setProgressCallback(ProgressCallback callback, void* user);
+
+        // threads building the adjacency at the start of optimize, 0 for
+        // one per core. 1 by default, since optimize mostly runs on worker
+        // threads already. The result is the same for any count.
+        void setThreads(unsigned int threads);
+
+        // logs the mesh size at LogInfo, see setLogCallback. When memory
+        // runs out it logs at LogError and the result is empty.
         void optimize(const MeshBuffer& buffer);
+
+        // same as above without the MeshBuffer, indices are triangles
+        // into [0, vert_cnt). The indices are only read before the first
+        // triangle is picked, so the result can be copied straight back
+        // over them, see copyIndices and optimizeInPlace.
+        void optimize(const uint32_t* indices, unsigned int idx_cnt, unsigned int vert_cnt);
+        void optimize(const uint16_t* indices, unsigned int idx_cnt, unsigned int vert_cnt);
+
+        // optimize, then the result written over indices
+        void optimizeInPlace(uint32_t* indices, unsigned int idx_cnt, unsigned int vert_cnt);
+        void optimizeInPlace(uint16_t* indices, unsigned int idx_cnt, unsigned int vert_cnt);
+
+        // Edits the result of the last optimize without starting over.
+        // removed holds triangles by their place in getIndices(), added
+        // holds new triangles into [0, vert_cnt). The removed triangles
+        // are grouped into spans of the order, each added triangle joins
+        // the span most of its neighbours are in, and only those spans are
+        // optimized again and spliced back, the rest keeps its order. Can
+        // be called again on its own result, see the README for how the
+        // ACMR drifts. Returns false and changes nothing when a triangle or
+        // an index is out of range, or a triangle is removed twice. Also
+        // false when memory runs out, with the result as it was, unless it
+        // ran out rebuilding the adjacency at the end: the edit is kept
+        // then, and the next update needs a new optimize first.
+        bool update(const unsigned int* removed, unsigned int removed_count,
+                    const unsigned int* added, unsigned int added_idx_cnt, unsigned int vert_cnt);
+
+        // drops the last mesh and its result but keeps the memory, so the
+        // next optimize of a mesh no bigger allocates nothing. optimize
+        // calls it itself. release also frees the memory.
+        void reset();
+        void release();
+
+        // logs the ACMR of buffer and of the result for the cache modeled
+        // at LogInfo, see analyzer for the numbers themselves
         void test_result(const MeshBuffer& buffer);
 
+        const PhaseTimes& getPhaseTimes() const;
+
+        // true when built with SP_VCACHE_STATS, see OptimizeStats
+        static bool statsEnabled();
+        const OptimizeStats& getStats() const;
+
         // returns the new index list
         unsigned int getIndexCount() const;
         const unsigned int * getIndices() const;
 
+        // the new index list narrowed to Index, out holds getIndexCount()
+        // entries. every index has to fit, see splitMesh in submesh.h
+        template <typename Index>
+        void copyIndices(Index* out) const
+        {
+            for (int i=0; i<NewIndexCount; ++i)
+                out[i] = (Index)NewTriangleList[i];
+        }
+
+        // triangles using each vertex from the last optimize, by their
+        // place in getIndices(). vertex i owns [offsets[i], offsets[i+1])
+        // of tris, getIndexCount() entries total. Only until the first
+        // update.
+        const int * getAdjacencyOffsets() const;
+        const int * getAdjacencyTris() const;
+
     private:
 
+        void _init_score_tables();
         void _init_scores();
-        void _init_verts(const MeshBuffer& buffer);
-        void _init_tris(const MeshBuffer& buffer);
+        template <typename Index> void _optimize(const Index* indices, unsigned int idx_cnt, unsigned int vert_cnt);
+        // false when the arena is out of memory
+        template <typename Index> bool _init_verts(const Index* indices, unsigned int idx_cnt, unsigned int vert_cnt);
+        template <typename Index> bool _init_tris(const Index* indices, unsigned int idx_cnt);
+        template <typename Index> void _init_verts_parallel(const Index* indices, unsigned int idx_cnt, int threads);
+        int _setup_threads(int tri_count) const;
         void _score_vertex(int index);
         void _score_triangle(int index);
-        int  _find_next_tri();
-        void _add_tri_to_LRU(int index);
+
+        // instantiated for every cache model in cachemodel.h, optimize
+        // picks one per mesh so the loop inlines the cache
+        template <typename Cache> void _run(Cache& cache);
+        template <typename Cache> int  _find_next_tri(const Cache& cache);
+        template <typename Cache> void _add_tri_to_cache(Cache& cache, int index);
+        void _init_best_tris();
+        void _update_best_tri(int index);
+        void _flush_best_tris();
+
+        // the adjacency as update keeps it, see AdjTris
+        void _adjacent(int vert, std::vector<int>& tris) const;
+        unsigned int _local_vert(unsigned int vert, std::vector<unsigned int>& verts);
+        void _add_adjacent(int vert, int tri);
+        void _remove_adjacent(int vert, int tri);
+        bool _rebuild_adjacency(int vert_cnt);
 
         float CacheDecayPower;
         float LastTriScore;
         float ValenceBoostScale;
         float ValenceBoostPower;
         int MaxSizeCache;
+        CacheModel Model;
 
-        struct Vertex
-        {
-            int maxValence;
-            int trisNotAdded;
-            int cache_pos;
-            float score;
-            std::vector<int> reference_list;
-        };
-
-        struct Triangle
-        {
-            bool in_cache;
-            float score;
-            int referenced_verts[3];
-        };
-
-        std::vector<Vertex>       Verts;
-        std::vector<Triangle>     Tris;
-        std::deque<int>           LRU;
-        std::vector<unsigned int> NewTriangleList;
+        ProgressCallback Progress;
+        void* ProgressUser;
+        unsigned int Threads;
+        PhaseTimes Times;
+        OptimizeStats Stats;
+
+        enum { CacheCapacity = 64, ValenceTableSize = 64 };
+
+        // _score_vertex terms, rebuilt from the parameters above.
+        // valences past the end of the table fall back to powf.
+        float CacheScores[CacheCapacity];
+        float ValenceScores[ValenceTableSize];
+
+        // all of the per mesh arrays below are carved out of Scratch.
+        // each field has an array of its own, so scoring a triangle only
+        // reads its three vertex numbers and three vertex scores.
+        Arena                     Scratch;
+
+        int                       VertCount;
+        float*                    VertScores;
+        int*                      VertCachePos;     // -1 when not in the cache
+        int*                      VertTrisLeft;     // triangles not added yet
+
+        int                       TriCount;
+        float*                    TriScores;
+        int*                      TriVerts;         // three per triangle
+        uint32_t*                 TriAdded;         // bit per triangle, in the cache already
+        uint32_t*                 TriDirty;         // bit per triangle, score changed since
+                                                    // the best tree was last updated
+
+        // triangles using each vertex, flattened. vertex i owns the slice
+        // [AdjOffsets[i], AdjOffsets[i+1]) of AdjTris, and the first
+        // VertTrisLeft[i] entries of that slice are the ones not added yet.
+        // an added triangle is stored by its place in NewTriangleList
+        // instead, so once all are added the slices map vertices to the
+        // result. update then treats the first VertTrisLeft[i] entries as
+        // free slots, and what doesn't fit goes to ExtraAdj.
+        int*                      AdjOffsets;
+        int*                      AdjTris;
+        std::vector<std::pair<int, int> > ExtraAdj;     // (vertex, triangle), sorted
+
+        // tournament tree over Tris used when the cache runs dry.
+        // leaves start at BestLeaves, node 1 is the root and holds the
+        // index of the highest scoring triangle not added yet (or -1).
+        // ties go to the lowest triangle index, same as a linear scan.
+        int                       BestLeaves;
+        int*                      BestTris;
+        int*                      DirtyTris;
+        int                       DirtyCount;
+        unsigned int*             NewTriangleList;
+        int                       NewIndexCount;
+
+        // NewTriangleList once update has changed it, the arena one can't grow
+        std::vector<unsigned int> EditedList;
+        bool                      Edited;
+        std::vector<int>          LocalVerts;       // vertex -> its number in the span
+                                                    // update optimizes, -1 otherwise
     };
 }
 #endif // VCACHE_H
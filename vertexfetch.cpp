@@ -0,0 +1,91 @@
+#include <vector>
+
+#include "lrucache.h"
+#include "vertexfetch.h"
+
+using namespace std;
+using namespace sp;
+
+namespace
+{
+    // a 4KB vertex fetch cache behind a 32 entry post transform cache
+    enum { LineSize = 64, LineCount = 64, TransformCount = 32 };
+
+    unsigned int vertexStride(const MeshBuffer& buffer)
+    {
+        unsigned int stride = sizeof(glm::vec3);
+        if (buffer.UsesNormals) stride += sizeof(glm::vec3);
+        if (buffer.UsesUVs) stride += sizeof(glm::vec2);
+        for (size_t i=0; i<buffer.UsesGenerics.size(); ++i)
+            if (buffer.UsesGenerics[i]) stride += sizeof(glm::vec4);
+        return stride;
+    }
+}
+
+float sp::vertexOverfetch(const MeshBuffer& buffer, const unsigned int* indices, unsigned int count)
+{
+    unsigned int vert_cnt = buffer.getVertCnt();
+    if (vert_cnt == 0 || count == 0) return 0.0f;
+
+    unsigned long long stride = vertexStride(buffer);
+    LruCache<TransformCount> transformed;
+    LruCache<LineCount> lines;
+    vector<bool> used(vert_cnt, false);
+    unsigned long long misses = 0;
+    unsigned long long used_verts = 0;
+
+    for (unsigned int i=0; i<count; ++i) {
+        unsigned int vert = indices[i];
+        if (!used[vert]) {
+            used[vert] = true;
+            used_verts++;
+        }
+
+        // only vertices that have to be transformed again are read from memory
+        int evicted;
+        bool hit = transformed.find((int)vert) >= 0;
+        transformed.touch((int)vert, evicted);
+        if (hit) continue;
+
+        // a vertex can straddle two lines
+        unsigned long long first = vert * stride / LineSize;
+        unsigned long long last = (vert * stride + stride - 1) / LineSize;
+        for (unsigned long long line=first; line<=last; ++line) {
+            if (lines.find((int)line) < 0) misses++;
+            lines.touch((int)line, evicted);
+        }
+    }
+
+    return (float)((double)(misses * LineSize) / (double)(used_verts * stride));
+}
+
+FetchStats sp::optimizeVertexFetch(MeshBuffer& buffer, unsigned int* indices, unsigned int count)
+{
+    FetchStats stats;
+    stats.overfetch_before = vertexOverfetch(buffer, indices, count);
+    stats.overfetch_after = stats.overfetch_before;
+    stats.unused = 0;
+
+    unsigned int vert_cnt = buffer.getVertCnt();
+    if (vert_cnt == 0) return stats;
+
+    const unsigned int unassigned = ~0u;
+    vector<uint32_t> remap(vert_cnt, unassigned);
+
+    unsigned int next = 0;
+    for (unsigned int i=0; i<count; ++i) {
+        unsigned int& slot = remap[indices[i]];
+        if (slot == unassigned) slot = next++;
+        indices[i] = slot;
+    }
+
+    // keep the unreferenced vertices, in their old order, after the rest
+    stats.unused = vert_cnt - next;
+    for (unsigned int i=0; i<vert_cnt; ++i)
+        if (remap[i] == unassigned) remap[i] = next++;
+
+    buffer.remapVertices(&remap[0]);
+
+    stats.overfetch_after = vertexOverfetch(buffer, indices, count);
+    return stats;
+}